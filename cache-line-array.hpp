@@ -0,0 +1,79 @@
+#ifndef CACHE_LINE_ARRAY_HPP
+#define CACHE_LINE_ARRAY_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// A fixed array of objects padded to whole cache lines, each starting on
+// a line of its own. new[] only aligns for the fundamental types, so an
+// array of it can straddle lines and share them with its neighbours.
+template<typename T>
+class CacheLineArray
+{
+public:
+	
+	static const std::size_t CACHE_LINE = 64;
+	
+	static_assert(sizeof(T) % CACHE_LINE == 0, "Objects must be padded to whole cache lines");
+	
+	
+	explicit CacheLineArray(std::size_t size)
+	: _memory(::operator new(size * sizeof(T) + CACHE_LINE))
+	, _items(_align(_memory, size))
+	, _size(0)
+	{
+		try
+		{
+			for (; _size < size; ++_size) new (_items + _size) T();
+		}
+		
+		catch (...)
+		{
+			_destroy();
+			
+			throw;
+		}
+	}
+	
+	CacheLineArray(const CacheLineArray&) = delete;
+	
+	CacheLineArray& operator=(const CacheLineArray&) = delete;
+	
+	~CacheLineArray()
+	{
+		_destroy();
+	}
+	
+	
+	// Like a pointer to the array, a const array has mutable objects
+	T& operator[](std::size_t index) const
+	{
+		return _items[index];
+	}
+	
+private:
+	
+	static T* _align(void* memory, std::size_t size)
+	{
+		auto space = size * sizeof(T) + CACHE_LINE;
+		
+		return static_cast<T*>(std::align(CACHE_LINE, size * sizeof(T), memory, space));
+	}
+	
+	void _destroy()
+	{
+		while (_size) _items[--_size].~T();
+		
+		::operator delete(_memory);
+	}
+	
+	
+	void* _memory;
+	
+	T* _items;
+	
+	std::size_t _size;
+};
+
+#endif /* CACHE_LINE_ARRAY_HPP */
@@ -0,0 +1,732 @@
+#ifndef CONCURRENT_CUCKOO_HASH_TABLE_HPP
+#define CONCURRENT_CUCKOO_HASH_TABLE_HPP
+
+#include "cache-line-array.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A cuckoo hash map for many threads, in the style of MemC3 and
+// libcuckoo. Both of a key's buckets are guarded by lock stripes that
+// double as version counters: writers lock the stripes, while readers
+// take no lock at all and instead retry whenever a stripe's version
+// changed under them. Since a reader may thus see a half-written
+// slot before discarding it, keys and values must be trivially copyable.
+template<typename Key, typename Value, std::size_t BucketSize = 4>
+class ConcurrentCuckooHashMap
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	using pre_hash_t = std::function<size_t(const Key&)>;
+	
+	// The number of lock stripes, which also bounds the writer concurrency
+	static const size_t STRIPES = 1024;
+	
+	static const size_t MINIMUM_CAPACITY = STRIPES * BucketSize;
+	
+	
+	ConcurrentCuckooHashMap(const pre_hash_t& pre_hash = std::hash<Key>(),
+							size_t capacity = MINIMUM_CAPACITY)
+	: _pre_hash(pre_hash)
+	, _table(new Table(_buckets(capacity)))
+	, _stripes(STRIPES)
+	{ }
+	
+	ConcurrentCuckooHashMap(const ConcurrentCuckooHashMap&) = delete;
+	
+	ConcurrentCuckooHashMap& operator=(const ConcurrentCuckooHashMap&) = delete;
+	
+	~ConcurrentCuckooHashMap()
+	{
+		delete _table.load();
+		
+		for (auto table : _retired) delete table;
+	}
+	
+	
+	// Inserts the key or assigns to it, returns true if it was new
+	bool insert(const Key& key, const Value& value)
+	{
+		auto hash = _hash(key);
+		
+		while (true)
+		{
+			const Table* table;
+			
+			{
+				BucketLock lock(*this, hash);
+				
+				table = lock.table;
+				
+				auto slot = _search(table, hash, key);
+				
+				if (slot)
+				{
+					slot->value = value;
+					
+					return false;
+				}
+				
+				slot = _vacancy(table, hash);
+				
+				if (slot)
+				{
+					slot->key = key;
+					slot->value = value;
+					
+					slot->hash.store(hash, std::memory_order_relaxed);
+					
+					_stripes[_stripe(table->first(hash))].count++;
+					
+					return true;
+				}
+			}
+			
+			if (! _cuckoo(table, hash)) _grow(table);
+		}
+	}
+	
+	// Applies the function to the key's value under its lock,
+	// returns false (without calling it) if there is no such key
+	template<typename Function>
+	bool update(const Key& key, Function function)
+	{
+		auto hash = _hash(key);
+		
+		BucketLock lock(*this, hash);
+		
+		auto slot = _search(lock.table, hash, key);
+		
+		if (slot) function(slot->value);
+		
+		return slot != nullptr;
+	}
+	
+	void erase(const Key& key)
+	{
+		if (! erase_if_found(key))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+	}
+	
+	bool erase_if_found(const Key& key)
+	{
+		auto hash = _hash(key);
+		
+		BucketLock lock(*this, hash);
+		
+		auto table = lock.table;
+		
+		auto slot = _search(table, hash, key);
+		
+		if (slot)
+		{
+			slot->hash.store(EMPTY, std::memory_order_relaxed);
+			
+			_stripes[_stripe(table->first(hash))].count--;
+		}
+		
+		return slot != nullptr;
+	}
+	
+	void clear()
+	{
+		AllLock lock(*this);
+		
+		auto table = _table.load(std::memory_order_relaxed);
+		
+		for (size_t i = 0; i < table->size(); ++i)
+		{
+			table->slots[i].hash.store(EMPTY, std::memory_order_relaxed);
+		}
+		
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe)
+		{
+			_stripes[stripe].count.store(0, std::memory_order_relaxed);
+		}
+	}
+	
+	
+	// Copies the key's value into the argument, returns false if absent
+	bool find(const Key& key, Value& value) const
+	{
+		auto hash = _hash(key);
+		
+		auto first = _stripe(hash);
+		auto second = _stripe(Table::alternate(hash, hash));
+		
+		while (true)
+		{
+			auto version_1 = _stripes[first].version.load(std::memory_order_acquire);
+			auto version_2 = _stripes[second].version.load(std::memory_order_acquire);
+			
+			// Wait for a writer to finish
+			if ((version_1 | version_2) & 1)
+			{
+				std::this_thread::yield();
+				
+				continue;
+			}
+			
+			auto table = _table.load(std::memory_order_acquire);
+			
+			auto slot = _search(table, hash, key);
+			
+			if (slot) value = slot->value;
+			
+			std::atomic_thread_fence(std::memory_order_acquire);
+			
+			if (_stripes[first].version.load(std::memory_order_relaxed) == version_1 &&
+				_stripes[second].version.load(std::memory_order_relaxed) == version_2)
+			{
+				return slot != nullptr;
+			}
+		}
+	}
+	
+	Value at(const Key& key) const
+	{
+		Value value;
+		
+		if (! find(key, value))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+		
+		return value;
+	}
+	
+	bool contains(const Key& key) const
+	{
+		Value value;
+		
+		return find(key, value);
+	}
+	
+	
+	// Only a snapshot, since other threads may be modifying the map
+	size_t size() const
+	{
+		size_t size = 0;
+		
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe)
+		{
+			size += _stripes[stripe].count.load(std::memory_order_relaxed);
+		}
+		
+		return size;
+	}
+	
+	bool is_empty() const
+	{
+		return size() == 0;
+	}
+	
+	size_t capacity() const
+	{
+		return _table.load(std::memory_order_acquire)->size();
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+private:
+	
+	using hash_t = std::uint64_t;
+	
+	static_assert(std::is_trivially_copyable<Key>::value &&
+				  std::is_trivially_copyable<Value>::value,
+				  "Optimistic reads need trivially copyable types!");
+				
+	static const hash_t EMPTY = 0;
+	
+	static const size_t CYCLE_LIMIT = 5;
+	
+	static const size_t SEARCH_LIMIT = 256;
+	
+	
+	struct Slot
+	{
+		// The key's full hash, or EMPTY
+		std::atomic<hash_t> hash;
+		
+		Key key;
+		Value value;
+	};
+	
+	struct Table
+	{
+		Table(size_t buckets)
+		: mask(buckets - 1)
+		, slots(new Slot[buckets * BucketSize])
+		{
+			for (size_t i = 0; i < size(); ++i)
+			{
+				slots[i].hash.store(EMPTY, std::memory_order_relaxed);
+			}
+		}
+		
+		~Table()
+		{
+			delete [] slots;
+		}
+		
+		size_t first(hash_t hash) const
+		{
+			return hash & mask;
+		}
+		
+		size_t second(hash_t hash) const
+		{
+			return alternate(first(hash), hash) & mask;
+		}
+		
+		// The other bucket of an item with the given hash,
+		// from the libcuckoo paper, which keeps the lower bits
+		// used to pick a stripe independent of the table size
+		static size_t alternate(size_t bucket, hash_t hash)
+		{
+			const hash_t tag = (hash >> 48) + 1;
+			
+			return bucket ^ (tag * 0xc6a4a7935bd1e995);
+		}
+		
+		size_t other(size_t bucket, hash_t hash) const
+		{
+			return (bucket == first(hash)) ? second(hash) : first(hash);
+		}
+		
+		Slot* bucket(size_t index) const
+		{
+			return slots + index * BucketSize;
+		}
+		
+		size_t buckets() const
+		{
+			return mask + 1;
+		}
+		
+		size_t size() const
+		{
+			return buckets() * BucketSize;
+		}
+		
+		const size_t mask;
+		
+		Slot* const slots;
+	};
+	
+	// A stripe's version is odd while a writer holds it
+	struct Stripe
+	{
+		Stripe()
+		: version(0)
+		, count(0)
+		{ }
+		
+		std::atomic<size_t> version;
+		
+		// The number of items whose first bucket is in the stripe
+		std::atomic<size_t> count;
+		
+		// Fill the stripe's cache line, which _stripes aligns it to
+		char padding[64 - 2 * sizeof(std::atomic<size_t>)];
+	};
+	
+	// Holds the stripes of the key's buckets while in scope
+	struct BucketLock
+	{
+		BucketLock(ConcurrentCuckooHashMap& map, hash_t hash)
+		: map(map)
+		, hash(hash)
+		, table(map._lock_buckets(hash))
+		{ }
+		
+		BucketLock(const BucketLock&) = delete;
+		
+		BucketLock& operator=(const BucketLock&) = delete;
+		
+		~BucketLock()
+		{
+			map._unlock_buckets(hash);
+		}
+		
+		ConcurrentCuckooHashMap& map;
+		
+		hash_t hash;
+		
+		// The table as of taking the locks, which no writer replaces meanwhile
+		const Table* table;
+	};
+	
+	// Holds every stripe while in scope
+	struct AllLock
+	{
+		explicit AllLock(ConcurrentCuckooHashMap& map)
+		: map(map)
+		{
+			map._lock_all();
+		}
+		
+		AllLock(const AllLock&) = delete;
+		
+		AllLock& operator=(const AllLock&) = delete;
+		
+		~AllLock()
+		{
+			map._unlock_all();
+		}
+		
+		ConcurrentCuckooHashMap& map;
+	};
+	
+	// A slot on a cuckoo path, along with the step before it
+	struct Step
+	{
+		size_t bucket;
+		size_t slot;
+		hash_t hash;
+		size_t previous;
+		size_t length;
+	};
+	
+	
+	static size_t _buckets(size_t capacity)
+	{
+		size_t buckets = STRIPES;
+		
+		while (buckets * BucketSize < capacity) buckets *= 2;
+		
+		return buckets;
+	}
+	
+	hash_t _hash(const Key& key) const
+	{
+		hash_t hash = _pre_hash(key);
+		
+		// The 64-bit finalizer of MurmurHash3
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccd;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53;
+		hash ^= hash >> 33;
+		
+		return (hash == EMPTY) ? 1 : hash;
+	}
+	
+	static size_t _stripe(size_t bucket)
+	{
+		return bucket & (STRIPES - 1);
+	}
+	
+	static Slot* _search(const Table* table, hash_t hash, const Key& key)
+	{
+		for (auto bucket : {table->first(hash), table->second(hash)})
+		{
+			auto slots = table->bucket(bucket);
+			
+			for (size_t i = 0; i < BucketSize; ++i)
+			{
+				if (slots[i].hash.load(std::memory_order_relaxed) == hash &&
+					slots[i].key == key)
+				{
+					return &slots[i];
+				}
+			}
+		}
+		
+		return nullptr;
+	}
+	
+	static Slot* _free_slot(const Table* table, size_t bucket)
+	{
+		auto slots = table->bucket(bucket);
+		
+		for (size_t i = 0; i < BucketSize; ++i)
+		{
+			if (slots[i].hash.load(std::memory_order_relaxed) == EMPTY)
+			{
+				return &slots[i];
+			}
+		}
+		
+		return nullptr;
+	}
+	
+	static Slot* _vacancy(const Table* table, hash_t hash)
+	{
+		auto slot = _free_slot(table, table->first(hash));
+		
+		return slot ? slot : _free_slot(table, table->second(hash));
+	}
+	
+	// Searches breadth-first for the shortest chain of displacements
+	// freeing a slot in one of the buckets, without holding any lock,
+	// then moves the items from the far end of the path backwards,
+	// locking only the two buckets involved in each move (unless the
+	// caller has the table to itself). Returns false if no path was
+	// found, true if one was (even if another writer invalidated it
+	// before it could be completed).
+	bool _cuckoo(const Table* table, hash_t hash, bool exclusive = false)
+	{
+		std::vector<Step> steps;
+		
+		steps.reserve(2 * BucketSize * (BucketSize + 1));
+		
+		for (auto bucket : {table->first(hash), table->second(hash)})
+		{
+			for (size_t slot = 0; slot < BucketSize; ++slot)
+			{
+				steps.push_back({bucket, slot, EMPTY, NONE, 1});
+			}
+		}
+		
+		for (size_t i = 0; i < steps.size() && i < SEARCH_LIMIT; ++i)
+		{
+			auto step = steps[i];
+			
+			auto& occupant = table->bucket(step.bucket)[step.slot];
+			
+			step.hash = occupant.hash.load(std::memory_order_relaxed);
+			
+			// Emptied since we looked at it, so there is room already
+			if (step.hash == EMPTY) return true;
+			
+			steps[i].hash = step.hash;
+			
+			auto other = table->other(step.bucket, step.hash);
+			
+			auto vacancy = _free_slot(table, other);
+			
+			if (vacancy)
+			{
+				size_t slot = vacancy - table->bucket(other);
+				
+				return _follow(table, steps, i, other, slot, exclusive);
+			}
+			
+			if (step.length == CYCLE_LIMIT) continue;
+			
+			for (size_t slot = 0; slot < BucketSize; ++slot)
+			{
+				steps.push_back({other, slot, EMPTY, i, step.length + 1});
+			}
+		}
+		
+		return false;
+	}
+	
+	bool _follow(const Table* table,
+				 const std::vector<Step>& steps,
+				 size_t last,
+				 size_t bucket,
+				 size_t slot,
+				 bool exclusive)
+	{
+		for (auto i = last; i != NONE; i = steps[i].previous)
+		{
+			auto& step = steps[i];
+			
+			if (exclusive) _move(table, step, bucket, slot);
+			
+			else if (! _locked_move(table, step, bucket, slot)) break;
+			
+			bucket = step.bucket;
+			
+			slot = step.slot;
+		}
+		
+		return true;
+	}
+	
+	// Moves an item one step along the path, provided that the
+	// table is still current, the item (or one with the same hash,
+	// and so the same buckets) is still there and its destination
+	// is still free.
+	bool _locked_move(const Table* table,
+					  const Step& step,
+					  size_t bucket,
+					  size_t slot)
+	{
+		auto first = _stripe(step.bucket);
+		auto second = _stripe(bucket);
+		
+		_lock(first, second);
+		
+		auto& source = table->bucket(step.bucket)[step.slot];
+		auto& destination = table->bucket(bucket)[slot];
+		
+		bool valid = _table.load(std::memory_order_relaxed) == table &&
+					 source.hash.load(std::memory_order_relaxed) == step.hash &&
+					 destination.hash.load(std::memory_order_relaxed) == EMPTY;
+					
+		if (valid) _move(table, step, bucket, slot);
+		
+		_unlock(first, second);
+		
+		return valid;
+	}
+	
+	static void _move(const Table* table,
+					  const Step& step,
+					  size_t bucket,
+					  size_t slot)
+	{
+		auto& source = table->bucket(step.bucket)[step.slot];
+		auto& destination = table->bucket(bucket)[slot];
+		
+		destination.key = source.key;
+		destination.value = source.value;
+		
+		destination.hash.store(step.hash, std::memory_order_relaxed);
+		
+		source.hash.store(EMPTY, std::memory_order_relaxed);
+	}
+	
+	// Doubles the table, unless another writer already replaced it
+	void _grow(const Table* old)
+	{
+		AllLock lock(*this);
+		
+		if (_table.load(std::memory_order_relaxed) != old) return;
+		
+		std::unique_ptr<Table> table(new Table(old->buckets() * 2));
+		
+		while (! _rehash(old, table.get()))
+		{
+			table.reset(new Table(table->buckets() * 2));
+		}
+		
+		// Readers that have not noticed yet may still be reading the
+		// old table, so it cannot be freed. Make room for it first, so
+		// that nothing throws once the new table is in place.
+		_retired.push_back(nullptr);
+		
+		_table.store(table.release(), std::memory_order_release);
+		
+		_retired.back() = old;
+	}
+	
+	// Only called with all stripes locked, so there is no need to lock
+	bool _rehash(const Table* old, Table* table)
+	{
+		for (size_t i = 0; i < old->size(); ++i)
+		{
+			auto& item = old->slots[i];
+			
+			auto hash = item.hash.load(std::memory_order_relaxed);
+			
+			if (hash == EMPTY) continue;
+			
+			auto slot = _vacancy(table, hash);
+			
+			while (! slot)
+			{
+				if (! _cuckoo(table, hash, true)) return false;
+				
+				slot = _vacancy(table, hash);
+			}
+			
+			slot->key = item.key;
+			slot->value = item.value;
+			
+			slot->hash.store(hash, std::memory_order_relaxed);
+		}
+		
+		return true;
+	}
+	
+	const Table* _lock_buckets(hash_t hash)
+	{
+		auto first = _stripe(hash);
+		
+		_lock(first, _stripe(Table::alternate(hash, hash)));
+		
+		return _table.load(std::memory_order_relaxed);
+	}
+	
+	void _unlock_buckets(hash_t hash)
+	{
+		_unlock(_stripe(hash), _stripe(Table::alternate(hash, hash)));
+	}
+	
+	// Locks in ascending order, so two writers cannot deadlock
+	void _lock(size_t first, size_t second)
+	{
+		if (first > second) std::swap(first, second);
+		
+		_lock(first);
+		
+		if (second != first) _lock(second);
+	}
+	
+	void _unlock(size_t first, size_t second)
+	{
+		_unlock(first);
+		
+		if (second != first) _unlock(second);
+	}
+	
+	void _lock(size_t stripe)
+	{
+		auto& version = _stripes[stripe].version;
+		
+		while (true)
+		{
+			auto current = version.load(std::memory_order_relaxed);
+			
+			if (! (current & 1) &&
+				version.compare_exchange_weak(current,
+											  current + 1,
+											  std::memory_order_acquire))
+			{
+				break;
+			}
+			
+			std::this_thread::yield();
+		}
+		
+		// Readers must see the odd version before any of our writes
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	
+	void _unlock(size_t stripe)
+	{
+		_stripes[stripe].version.fetch_add(1, std::memory_order_release);
+	}
+	
+	void _lock_all()
+	{
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe) _lock(stripe);
+	}
+	
+	void _unlock_all()
+	{
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe) _unlock(stripe);
+	}
+	
+	
+	static const size_t NONE = static_cast<size_t>(-1);
+	
+	pre_hash_t _pre_hash;
+	
+	std::atomic<const Table*> _table;
+	
+	CacheLineArray<Stripe> _stripes;
+	
+	std::vector<const Table*> _retired;
+};
+
+#endif /* CONCURRENT_CUCKOO_HASH_TABLE_HPP */
\ No newline at end of file
@@ -0,0 +1,846 @@
+#ifndef CONCURRENT_OPEN_ADDRESSING_HASH_TABLE_HPP
+#define CONCURRENT_OPEN_ADDRESSING_HASH_TABLE_HPP
+
+#include "cache-line-array.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+// A lock-free linear-probing hash table for many threads, in the style
+// of Cliff Click's NonBlockingHashMap, for integer keys and values of
+// up to 64 bits. Slots hold the key and value inline as atomic words:
+// writers claim a key's slot and update its value with compare-and-swap,
+// while lookups only read, and finish in a bounded number of steps.
+//
+// A full table is not rebuilt by one thread under a lock, but copied
+// into a larger one by all writers together, a chunk of slots each
+// whenever they find a copy under way. A slot being copied is frozen
+// (primed) in place, so that readers still see its value while writers
+// wait for it to reach the new table, and then go on there.
+//
+// Replaced tables are freed by epoch-based reclamation, as in the
+// split-ordered table: every operation announces the epoch it started
+// in, and a table is freed once all operations from the epoch it was
+// replaced in have ended. At most OPERATIONS run at once, any more wait.
+//
+// Two 64-bit keys are reserved, 2^63 and 2^63 + 1 (as unsigned, or the
+// two lowest as signed), and values are kept in 62 bits, so those of a
+// 64-bit type must fit in them: an update wraps around in 62 bits.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentOpenAddressingHashTable
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	using pre_hash_t = Hash;
+	
+	// The number of epoch announcements, which bounds the operations at once
+	static const size_t OPERATIONS = 256;
+	
+	static const size_t MINIMUM_CAPACITY = 64;
+	
+	
+	ConcurrentOpenAddressingHashTable(const pre_hash_t& pre_hash = pre_hash_t(),
+									  size_t capacity = MINIMUM_CAPACITY)
+	: _pre_hash(pre_hash)
+	, _oldest(new Table(_capacity(capacity)))
+	, _table(_oldest.load())
+	, _counters(COUNTERS)
+	, _epoch(0)
+	, _announcements(OPERATIONS)
+	, _reclaiming(false)
+	{ }
+	
+	ConcurrentOpenAddressingHashTable(const ConcurrentOpenAddressingHashTable&) = delete;
+	
+	ConcurrentOpenAddressingHashTable& operator=(const ConcurrentOpenAddressingHashTable&) = delete;
+	
+	~ConcurrentOpenAddressingHashTable()
+	{
+		for (auto table = _oldest.load(); table; )
+		{
+			auto next = table->next.load(std::memory_order_relaxed);
+			
+			delete table;
+			
+			table = next;
+		}
+	}
+	
+	
+	// Inserts the key or assigns to it, returns true if it was new
+	bool insert(const Key& key, const Value& value)
+	{
+		Guard guard(*this);
+		
+		auto word = _live(value);
+		
+		auto previous = _update(_claimable(key), true, [word] (word_t)
+		{
+			return word;
+		});
+		
+		return _tag(previous) != LIVE;
+	}
+	
+	// Adds to the key's value, inserting it with a value of zero first
+	// if it is not there, and returns the value from before
+	Value fetch_add(const Key& key, const Value& addend)
+	{
+		Guard guard(*this);
+		
+		auto previous = _update(_claimable(key), true, [addend] (word_t current)
+		{
+			auto value = (_tag(current) == LIVE) ? _value(current) : Value();
+			
+			return _live(static_cast<Value>(value + addend));
+		});
+		
+		return (_tag(previous) == LIVE) ? _value(previous) : Value();
+	}
+	
+	void erase(const Key& key)
+	{
+		if (! erase_if_found(key))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+	}
+	
+	bool erase_if_found(const Key& key)
+	{
+		auto word = _key_word(key);
+		
+		if (word <= SEALED) return false;
+		
+		Guard guard(*this);
+		
+		auto previous = _update(word, false, [] (word_t current)
+		{
+			return (_tag(current) == LIVE) ? word_t(TOMBSTONE) : current;
+		});
+		
+		return _tag(previous) == LIVE;
+	}
+	
+	
+	// Copies the key's value into the argument, returns false if absent.
+	// Wait-free but for waiting on an announcement when OPERATIONS are
+	// running: each table a lookup passes through takes at most as many
+	// steps as its longest probe sequence, and there are no retries.
+	bool find(const Key& key, Value& value) const
+	{
+		auto word = _key_word(key);
+		
+		if (word <= SEALED) return false;
+		
+		auto hash = _hash(key);
+		
+		Guard guard(*this);
+		
+		for (auto table = _table.load(); table; )
+		{
+			auto index = _search(table, word, hash);
+			
+			if (index == NONE) return false;
+			
+			if (index != NEXT)
+			{
+				auto current = table->slots[index].value.load(std::memory_order_acquire);
+				
+				if (! _moved(current))
+				{
+					// A primed value is still the latest one
+					if (_tag(current) == LIVE || _tag(current) == PRIMED)
+					{
+						value = _value(current);
+						
+						return true;
+					}
+					
+					return false;
+				}
+			}
+			
+			table = table->next.load(std::memory_order_acquire);
+		}
+		
+		return false;
+	}
+	
+	Value at(const Key& key) const
+	{
+		Value value;
+		
+		if (! find(key, value))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+		
+		return value;
+	}
+	
+	bool contains(const Key& key) const
+	{
+		Value value;
+		
+		return find(key, value);
+	}
+	
+	
+	// Only a snapshot, since other threads may be modifying the table
+	size_t size() const
+	{
+		size_t size = 0;
+		
+		for (size_t counter = 0; counter < COUNTERS; ++counter)
+		{
+			size += _counters[counter].count.load(std::memory_order_relaxed);
+		}
+		
+		return size;
+	}
+	
+	bool is_empty() const
+	{
+		return size() == 0;
+	}
+	
+	size_t capacity() const
+	{
+		Guard guard(*this);
+		
+		return _table.load()->capacity();
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+private:
+	
+	using word_t = std::uint64_t;
+	
+	using hash_t = std::uint64_t;
+	
+	static_assert(std::is_integral<Key>::value && sizeof(Key) <= sizeof(word_t) &&
+				  std::is_integral<Value>::value && sizeof(Value) <= sizeof(word_t),
+				  "Keys and values must be integers of at most 64 bits!");
+	
+	// Key words, of which those of keys are never one of these two,
+	// since a key's word is the key with its highest bit flipped
+	static const word_t FREE = 0;
+	static const word_t SEALED = 1;
+	
+	static const word_t FLIP = word_t(1) << 63;
+	
+	// The low two bits of a value word tag its state, while the other
+	// bits hold the value, if any. A primed value is being copied into
+	// the next table, a tombstone of one is a slot done copying.
+	enum : word_t { EMPTY = 0, LIVE = 1, TOMBSTONE = 2, PRIMED = 3 };
+	
+	static const word_t TOMBPRIME = (1 << 2) | TOMBSTONE;
+	
+	// A slot copied while its key had no value yet. A copier late with
+	// the value carries it on into the table after, which it must not do
+	// past a tombstone, since that key was erased after the copy.
+	static const word_t EMPTYPRIME = (1 << 2) | EMPTY;
+	
+	// The number of slots a writer copies whenever it finds a copy under way
+	static const size_t CHUNK = 1024;
+	
+	static const size_t COUNTERS = 64;
+	
+	static const size_t NONE = static_cast<size_t>(-1);
+	
+	// The epoch of a free announcement, or of a table not yet replaced
+	static const std::uint64_t IDLE = static_cast<std::uint64_t>(-1);
+	
+	// What a search returns when the key can only be in the next table
+	static const size_t NEXT = NONE - 1;
+	
+	
+	struct Slot
+	{
+		std::atomic<word_t> key;
+		
+		std::atomic<word_t> value;
+	};
+	
+	struct Table
+	{
+		Table(size_t capacity)
+		: mask(capacity - 1)
+		, slots(new Slot[capacity])
+		, next(nullptr)
+		, claimed(0)
+		, handed_out(0)
+		, copied(0)
+		, replaced(IDLE)
+		{
+			for (size_t i = 0; i < capacity; ++i)
+			{
+				slots[i].key.store(FREE, std::memory_order_relaxed);
+				
+				slots[i].value.store(EMPTY, std::memory_order_relaxed);
+			}
+		}
+		
+		~Table()
+		{
+			delete [] slots;
+		}
+		
+		size_t capacity() const
+		{
+			return mask + 1;
+		}
+		
+		// A key is never further than this from its home slot, else it
+		// goes into the next table, so lookups can stop there
+		size_t probe_limit() const
+		{
+			return 16 + capacity() / 16;
+		}
+		
+		const size_t mask;
+		
+		Slot* const slots;
+		
+		// The table being copied into, if any
+		std::atomic<Table*> next;
+		
+		// The number of slots a key has taken, which is never given
+		// back, since erasing only leaves a tombstone as the value
+		std::atomic<size_t> claimed;
+		
+		// The first slot of the next chunk to copy
+		std::atomic<size_t> handed_out;
+		
+		// The number of slots done copying
+		std::atomic<size_t> copied;
+		
+		// The epoch the next table took its place in
+		std::atomic<std::uint64_t> replaced;
+	};
+	
+	// Counters on cache lines of their own, which _counters aligns them to
+	struct Counter
+	{
+		Counter()
+		: count(0)
+		{ }
+		
+		std::atomic<size_t> count;
+		
+		char padding[64 - sizeof(std::atomic<size_t>)];
+	};
+	
+	// The epoch an operation started in, or IDLE while free
+	struct Announcement
+	{
+		Announcement()
+		: epoch(IDLE)
+		{ }
+		
+		std::atomic<std::uint64_t> epoch;
+		
+		// Fill the announcement's cache line, which _announcements aligns it to
+		char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+	};
+	
+	// Holds an announcement for the duration of an operation
+	struct Guard
+	{
+		Guard(const ConcurrentOpenAddressingHashTable& table_)
+		: table(table_)
+		, announcement(table_._enter())
+		{ }
+		
+		~Guard()
+		{
+			table._leave(announcement);
+		}
+		
+		const ConcurrentOpenAddressingHashTable& table;
+		
+		Announcement& announcement;
+	};
+	
+	
+	static size_t _capacity(size_t capacity)
+	{
+		size_t power = MINIMUM_CAPACITY;
+		
+		while (power < capacity) power *= 2;
+		
+		return power;
+	}
+	
+	static word_t _key_word(const Key& key)
+	{
+		return static_cast<word_t>(key) ^ FLIP;
+	}
+	
+	static Key _key(word_t word)
+	{
+		return static_cast<Key>(word ^ FLIP);
+	}
+	
+	static word_t _claimable(const Key& key)
+	{
+		auto word = _key_word(key);
+		
+		if (word <= SEALED) throw std::invalid_argument("The key is reserved!");
+		
+		return word;
+	}
+	
+	static word_t _tag(word_t word)
+	{
+		return word & 3;
+	}
+	
+	// Whether the slot is done copying, its value (if any) in the next table
+	static bool _moved(word_t word)
+	{
+		return word == TOMBPRIME || word == EMPTYPRIME;
+	}
+	
+	static word_t _live(Value value)
+	{
+		return (static_cast<word_t>(value) << 2) | LIVE;
+	}
+	
+	// Shifting a signed word back extends its sign
+	static Value _value(word_t word)
+	{
+		if (std::is_signed<Value>::value)
+		{
+			return static_cast<Value>(static_cast<std::int64_t>(word) >> 2);
+		}
+		
+		return static_cast<Value>(word >> 2);
+	}
+	
+	hash_t _hash(const Key& key) const
+	{
+		hash_t hash = _pre_hash(key);
+		
+		// The 64-bit finalizer of MurmurHash3
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccd;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53;
+		hash ^= hash >> 33;
+		
+		return hash;
+	}
+	
+	// The slot holding the key, else NONE if it is in no table at all
+	// (its probe sequence reaches a free slot, which it would have taken),
+	// or NEXT if it can only be in the next one
+	static size_t _search(const Table* table, word_t word, hash_t hash)
+	{
+		auto index = hash & table->mask;
+		
+		for (size_t probe = 0; probe < table->probe_limit(); ++probe)
+		{
+			auto current = table->slots[index].key.load(std::memory_order_acquire);
+			
+			if (current == word) return index;
+			
+			if (current == FREE) return NONE;
+			
+			if (current == SEALED) return NEXT;
+			
+			index = (index + 1) & table->mask;
+		}
+		
+		return NEXT;
+	}
+	
+	// Like _search, but takes the first free slot for the key, and
+	// starts a resize once half of the slots have been taken
+	size_t _claim(Table* table, word_t word, hash_t hash)
+	{
+		auto index = hash & table->mask;
+		
+		for (size_t probe = 0; probe < table->probe_limit(); ++probe)
+		{
+			auto& key = table->slots[index].key;
+			
+			auto current = key.load(std::memory_order_acquire);
+			
+			if (current == FREE &&
+				key.compare_exchange_strong(current, word, std::memory_order_acq_rel))
+			{
+				auto claimed = table->claimed.fetch_add(1, std::memory_order_relaxed) + 1;
+				
+				if (claimed >= table->capacity() / 2) _resize(table, false);
+				
+				return index;
+			}
+			
+			// Either taken by the key, perhaps by another thread just now
+			if (current == word) return index;
+			
+			if (current == SEALED) return NEXT;
+			
+			index = (index + 1) & table->mask;
+		}
+		
+		return NEXT;
+	}
+	
+	// Replaces the word of the key's value with what the update makes
+	// of it, in the newest table, and returns the word from before.
+	// The key is only given a slot if it has none and claim is set.
+	template<typename Update>
+	word_t _update(word_t word, bool claim, Update update)
+	{
+		auto hash = _hash(_key(word));
+		
+		auto table = _table.load();
+		
+		while (true)
+		{
+			auto index = claim ? _claim(table, word, hash) : _search(table, word, hash);
+			
+			if (index == NONE) return EMPTY;
+			
+			if (index == NEXT)
+			{
+				auto next = table->next.load(std::memory_order_acquire);
+				
+				if (! next)
+				{
+					if (! claim) return EMPTY;
+					
+					next = _resize(table, true);
+				}
+				
+				_help(table);
+				
+				table = next;
+				
+				continue;
+			}
+			
+			auto& value = table->slots[index].value;
+			
+			auto current = value.load(std::memory_order_acquire);
+			
+			// Writers leave a table alone once a copy of it is under way
+			while (! table->next.load(std::memory_order_acquire))
+			{
+				if (_moved(current) || _tag(current) == PRIMED) break;
+				
+				auto desired = update(current);
+				
+				if (desired == current) return current;
+				
+				if (value.compare_exchange_weak(current,
+												desired,
+												std::memory_order_acq_rel))
+				{
+					_count(hash, current, desired);
+					
+					return current;
+				}
+			}
+			
+			// The key may only be written in the next table once its slot here is copied
+			if (_copy_slot(table, index)) _copied(table, 1);
+			
+			_help(table);
+			
+			table = table->next.load(std::memory_order_acquire);
+		}
+	}
+	
+	// Keeps count of live values as they come and go
+	void _count(hash_t hash, word_t before, word_t after)
+	{
+		auto& count = _counters[hash & (COUNTERS - 1)].count;
+		
+		if (_tag(before) != LIVE && _tag(after) == LIVE)
+		{
+			count.fetch_add(1, std::memory_order_relaxed);
+		}
+		
+		else if (_tag(before) == LIVE && _tag(after) != LIVE)
+		{
+			count.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+	
+	// The next table, which is made if there is none yet, four times
+	// the current size, or (if a key ran into the probe limit) at least
+	// twice the capacity. Concurrent callers may all make one, but only
+	// one of them becomes the next table.
+	Table* _resize(Table* table, bool longer)
+	{
+		auto next = table->next.load(std::memory_order_acquire);
+		
+		if (next) return next;
+		
+		auto capacity = _capacity(4 * size());
+		
+		if (longer) capacity = std::max(capacity, 2 * table->capacity());
+		
+		auto fresh = new Table(capacity);
+		
+		if (! table->next.compare_exchange_strong(next,
+												  fresh,
+												  std::memory_order_acq_rel))
+		{
+			delete fresh;
+			
+			return next;
+		}
+		
+		return fresh;
+	}
+	
+	// Copies the next chunk of slots, if any are left
+	void _help(Table* table)
+	{
+		auto first = table->handed_out.fetch_add(CHUNK, std::memory_order_relaxed);
+		
+		auto last = std::min(first + CHUNK, table->capacity());
+		
+		size_t done = 0;
+		
+		for (auto index = first; index < last; ++index)
+		{
+			if (_copy_slot(table, index)) ++done;
+		}
+		
+		_copied(table, done);
+	}
+	
+	// Finishes copying the slot into the next table, whether or not
+	// another thread started, and returns true if this call did so.
+	// A free slot is sealed, so that no key can take it any more.
+	bool _copy_slot(Table* table, size_t index)
+	{
+		auto& slot = table->slots[index];
+		
+		auto key = slot.key.load(std::memory_order_acquire);
+		
+		while (key == FREE)
+		{
+			if (slot.key.compare_exchange_weak(key, SEALED, std::memory_order_acq_rel))
+			{
+				return true;
+			}
+		}
+		
+		if (key == SEALED) return false;
+		
+		auto current = slot.value.load(std::memory_order_acquire);
+		
+		// Primes a live value, marks any other as copied right away
+		while (_tag(current) != PRIMED)
+		{
+			if (_moved(current)) return false;
+			
+			auto desired = (_tag(current) == LIVE) ? (current | PRIMED) :
+						   (current == EMPTY) ? EMPTYPRIME : TOMBPRIME;
+			
+			if (slot.value.compare_exchange_weak(current,
+												 desired,
+												 std::memory_order_acq_rel))
+			{
+				if (_moved(desired)) return true;
+				
+				current = desired;
+			}
+		}
+		
+		_copy_into(table->next.load(std::memory_order_acquire),
+				   key,
+				   (current & ~word_t(3)) | LIVE);
+		
+		// Only ever fails if another thread got there first
+		return slot.value.compare_exchange_strong(current,
+												  TOMBPRIME,
+												  std::memory_order_acq_rel);
+	}
+	
+	// Puts the value in the key's slot, unless another thread copied it
+	// there first. No writer touches the slot until the copy is done, but
+	// a copy of the table onwards may have marked it copied while empty,
+	// in which case the value goes on into the table after. Once it holds
+	// anything else, such as a tombstone of a later erase, it stays so.
+	void _copy_into(Table* table, word_t word, word_t live)
+	{
+		auto hash = _hash(_key(word));
+		
+		while (true)
+		{
+			auto index = _claim(table, word, hash);
+			
+			if (index != NEXT)
+			{
+				word_t current = EMPTY;
+				
+				if (table->slots[index].value.compare_exchange_strong(current,
+																	  live,
+																	  std::memory_order_acq_rel) ||
+					current != EMPTYPRIME)
+				{
+					return;
+				}
+				
+				table = table->next.load(std::memory_order_acquire);
+			}
+			
+			else table = _resize(table, true);
+		}
+	}
+	
+	// Once every slot of a table is copied, the next one takes its place
+	void _copied(Table* table, size_t done)
+	{
+		if (! done) return;
+		
+		if (table->copied.fetch_add(done, std::memory_order_acq_rel) + done < table->capacity())
+		{
+			return;
+		}
+		
+		// Tables are replaced in order, so a later one may have been
+		// done copying first, and is then replaced here as well
+		auto top = _table.load(std::memory_order_acquire);
+		
+		while (top->copied.load(std::memory_order_acquire) == top->capacity())
+		{
+			auto next = top->next.load(std::memory_order_acquire);
+			
+			if (_table.compare_exchange_strong(top, next))
+			{
+				// Operations from this epoch on only ever reach newer tables
+				top->replaced.store(_epoch.load());
+				
+				top = next;
+			}
+		}
+	}
+	
+	
+	// The announcement and the loads of _table after it are sequentially
+	// consistent, as is replacing a table, so that either a reclaimer sees
+	// the operation's epoch, or the operation sees the newer table
+	Announcement& _enter() const
+	{
+		// Each thread starts from the announcement it last took, which
+		// is then usually free, and whose cache line it likely still has
+		static thread_local size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+		
+		for (size_t attempt = 0; ; ++attempt)
+		{
+			auto& announcement = _announcements[(start + attempt) % OPERATIONS];
+			
+			auto idle = IDLE;
+			
+			if (announcement.epoch.load(std::memory_order_relaxed) == IDLE &&
+				announcement.epoch.compare_exchange_strong(idle, _epoch.load()))
+			{
+				start += attempt;
+				
+				return announcement;
+			}
+			
+			if (attempt % OPERATIONS == OPERATIONS - 1) std::this_thread::yield();
+		}
+	}
+	
+	void _leave(Announcement& announcement) const
+	{
+		announcement.epoch.store(IDLE, std::memory_order_release);
+		
+		if (_oldest.load(std::memory_order_acquire) != _table.load(std::memory_order_acquire))
+		{
+			_reclaim();
+		}
+	}
+	
+	// Moves to the next epoch, if no operation is still in an older one
+	void _advance() const
+	{
+		auto epoch = _epoch.load();
+		
+		for (size_t index = 0; index < OPERATIONS; ++index)
+		{
+			auto announced = _announcements[index].epoch.load();
+			
+			if (announced != IDLE && announced != epoch) return;
+		}
+		
+		_epoch.compare_exchange_strong(epoch, epoch + 1);
+	}
+	
+	// Frees the tables replaced two epochs ago or more, which only
+	// operations that have since ended could have reached. Tables are
+	// replaced in order, so these are the oldest ones. Only one thread
+	// reclaims at a time, and the others leave it to that one.
+	void _reclaim() const
+	{
+		if (_reclaiming.load(std::memory_order_relaxed) ||
+			_reclaiming.exchange(true, std::memory_order_acquire))
+		{
+			return;
+		}
+		
+		_advance();
+		
+		auto epoch = _epoch.load();
+		
+		auto oldest = _oldest.load(std::memory_order_relaxed);
+		
+		while (true)
+		{
+			auto replaced = oldest->replaced.load();
+			
+			if (replaced == IDLE || replaced + 2 > epoch) break;
+			
+			auto next = oldest->next.load(std::memory_order_acquire);
+			
+			delete oldest;
+			
+			oldest = next;
+		}
+		
+		_oldest.store(oldest, std::memory_order_release);
+		
+		_reclaiming.store(false, std::memory_order_release);
+	}
+	
+	
+	pre_hash_t _pre_hash;
+	
+	// The first of the tables not yet freed, each of which links to the next
+	mutable std::atomic<Table*> _oldest;
+	
+	std::atomic<Table*> _table;
+	
+	CacheLineArray<Counter> _counters;
+	
+	mutable std::atomic<std::uint64_t> _epoch;
+	
+	CacheLineArray<Announcement> _announcements;
+	
+	mutable std::atomic<bool> _reclaiming;
+};
+
+#endif /* CONCURRENT_OPEN_ADDRESSING_HASH_TABLE_HPP */
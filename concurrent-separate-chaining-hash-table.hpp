@@ -0,0 +1,645 @@
+#ifndef CONCURRENT_SEPARATE_CHAINING_HASH_TABLE_HPP
+#define CONCURRENT_SEPARATE_CHAINING_HASH_TABLE_HPP
+
+#include "cache-line-array.hpp"
+#include "pre-hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+// A separate chaining hash table for many threads. Buckets are guarded
+// by lock stripes, each a reader/writer lock, so that lookups share a
+// stripe while writers take it for themselves, and threads working on
+// different stripes never wait for each other. Keys and values may be of
+// any type, since readers hold a lock rather than reading optimistically.
+//
+// The table grows a stripe at a time rather than all at once: once it
+// is due to grow, a larger bucket array is made, and each writer moves
+// the chains of its own stripe there before it goes on (plus those of
+// one more stripe, so that stripes nobody writes to move as well). A
+// stripe holds the buckets whose indices have the same low bits, which
+// it keeps in an array of any size, so that while the table grows each
+// stripe's buckets are in one array or the other, never in both.
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>
+>
+class ConcurrentSeparateChainingHashTable
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	using pre_hash_t = Hash;
+	
+	using key_equal_t = KeyEqual;
+	
+	// The number of lock stripes, which also bounds the writer concurrency
+	static const size_t STRIPES = 1024;
+	
+	static const size_t MINIMUM_CAPACITY = STRIPES;
+	
+	
+	ConcurrentSeparateChainingHashTable(const pre_hash_t& pre_hash = pre_hash_t(),
+										size_t load_factor = 4,
+										size_t capacity = MINIMUM_CAPACITY,
+										const key_equal_t& key_equal = key_equal_t())
+	: _pre_hash(pre_hash)
+	, _key_equal(key_equal)
+	, _load_factor(load_factor)
+	, _table(new Table(_buckets(capacity / load_factor)))
+	, _next(nullptr)
+	, _stripes(STRIPES)
+	{
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe)
+		{
+			_stripes[stripe].table = _table.load(std::memory_order_relaxed);
+		}
+	}
+	
+	ConcurrentSeparateChainingHashTable(const ConcurrentSeparateChainingHashTable&) = delete;
+	
+	ConcurrentSeparateChainingHashTable& operator=(const ConcurrentSeparateChainingHashTable&) = delete;
+	
+	~ConcurrentSeparateChainingHashTable()
+	{
+		_clear();
+		
+		delete _next.load();
+		
+		for (const Table* table = _table.load(); table; )
+		{
+			auto older = table->older;
+			
+			delete table;
+			
+			table = older;
+		}
+	}
+	
+	
+	// Inserts the key or assigns to it, returns true if it was new
+	bool insert(const Key& key, const Value& value)
+	{
+		auto hash = _hash(key);
+		
+		Table* table;
+		
+		Node* node;
+		
+		bool full;
+		
+		{
+			WriteLock lock(*this, _stripe(hash));
+			
+			auto& stripe = lock.stripe;
+			
+			table = stripe.table;
+			
+			auto& head = table->bucket(hash);
+			
+			node = _search(head, key);
+			
+			if (node) node->value = value;
+			
+			else
+			{
+				head = new Node(key, value, head);
+				
+				stripe.count.fetch_add(1, std::memory_order_relaxed);
+			}
+			
+			full = stripe.count.load(std::memory_order_relaxed) >
+				   _load_factor * (table->buckets() / STRIPES);
+		}
+		
+		if (full) _grow(table);
+		
+		_help();
+		
+		return ! node;
+	}
+	
+	// Applies the function to the key's value under its lock,
+	// returns false (without calling it) if there is no such key
+	template<typename Function>
+	bool update(const Key& key, Function function)
+	{
+		auto hash = _hash(key);
+		
+		bool found;
+		
+		{
+			WriteLock lock(*this, _stripe(hash));
+			
+			auto node = _search(lock.stripe.table->bucket(hash), key);
+			
+			found = node != nullptr;
+			
+			if (found) function(node->value);
+		}
+		
+		_help();
+		
+		return found;
+	}
+	
+	void erase(const Key& key)
+	{
+		if (! erase_if_found(key))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+	}
+	
+	bool erase_if_found(const Key& key)
+	{
+		auto hash = _hash(key);
+		
+		bool found = false;
+		
+		{
+			WriteLock lock(*this, _stripe(hash));
+			
+			auto& stripe = lock.stripe;
+			
+			for (auto link = &stripe.table->bucket(hash); *link; link = &(*link)->next)
+			{
+				if (_key_equal((*link)->key, key))
+				{
+					auto node = *link;
+					
+					*link = node->next;
+					
+					delete node;
+					
+					stripe.count.fetch_sub(1, std::memory_order_relaxed);
+					
+					found = true;
+					
+					break;
+				}
+			}
+		}
+		
+		_help();
+		
+		return found;
+	}
+	
+	void clear()
+	{
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe) _lock(_stripes[stripe]);
+		
+		_clear();
+		
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe) _unlock(_stripes[stripe]);
+	}
+	
+	
+	// Copies the key's value into the argument, returns false if absent
+	bool find(const Key& key, Value& value) const
+	{
+		auto hash = _hash(key);
+		
+		ReadLock lock(*this, hash);
+		
+		auto node = _search(lock.stripe.table->bucket(hash), key);
+		
+		if (node) value = node->value;
+		
+		return node != nullptr;
+	}
+	
+	Value at(const Key& key) const
+	{
+		Value value;
+		
+		if (! find(key, value))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+		
+		return value;
+	}
+	
+	bool contains(const Key& key) const
+	{
+		auto hash = _hash(key);
+		
+		ReadLock lock(*this, hash);
+		
+		return _search(lock.stripe.table->bucket(hash), key) != nullptr;
+	}
+	
+	
+	// Only a snapshot, since other threads may be modifying the table
+	size_t size() const
+	{
+		size_t size = 0;
+		
+		for (size_t stripe = 0; stripe < STRIPES; ++stripe)
+		{
+			size += _stripes[stripe].count.load(std::memory_order_relaxed);
+		}
+		
+		return size;
+	}
+	
+	bool is_empty() const
+	{
+		return size() == 0;
+	}
+	
+	// The number of buckets, counting those of a growth under way
+	size_t capacity() const
+	{
+		auto next = _next.load(std::memory_order_acquire);
+		
+		return (next ? next : _table.load(std::memory_order_acquire))->buckets();
+	}
+	
+	size_t load_factor() const
+	{
+		return _load_factor;
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+	const key_equal_t& key_equal() const
+	{
+		return _key_equal;
+	}
+	
+private:
+	
+	using hash_t = std::uint64_t;
+	
+	struct Node
+	{
+		Node(const Key& key_, const Value& value_, Node* next_)
+		: key(key_)
+		, value(value_)
+		, next(next_)
+		{ }
+		
+		Key key;
+		
+		Value value;
+		
+		Node* next;
+	};
+	
+	struct Table
+	{
+		Table(size_t buckets)
+		: mask(buckets - 1)
+		, heads(new Node*[buckets])
+		, handed_out(0)
+		, moved(0)
+		, older(nullptr)
+		{
+			std::fill(heads, heads + buckets, nullptr);
+		}
+		
+		~Table()
+		{
+			delete [] heads;
+		}
+		
+		Node*& bucket(hash_t hash) const
+		{
+			return heads[hash & mask];
+		}
+		
+		size_t buckets() const
+		{
+			return mask + 1;
+		}
+		
+		const size_t mask;
+		
+		Node** const heads;
+		
+		// The next stripe for a writer to help move into the table
+		std::atomic<size_t> handed_out;
+		
+		// The number of stripes moved into the table
+		std::atomic<size_t> moved;
+		
+		// The array the table grew from, kept for readers until the destructor
+		const Table* older;
+	};
+	
+	// A reader/writer lock, with the number of readers in the low bits
+	// of its state, and the top bit set while a writer holds it or waits
+	// for the readers to leave, which keeps new readers out meanwhile
+	struct Stripe
+	{
+		Stripe()
+		: count(0)
+		, table(nullptr)
+		, state(0)
+		{ }
+		
+		// The number of entries in the stripe's buckets
+		std::atomic<size_t> count;
+		
+		// The array holding the stripe's buckets, only read under its lock
+		Table* table;
+		
+		mutable std::atomic<std::uint32_t> state;
+		
+		// Fill the stripe's cache line, which _stripes aligns it to
+		char padding[64 - sizeof(std::atomic<size_t>) - sizeof(Table*) - sizeof(std::atomic<std::uint32_t>)];
+	};
+	
+	static const std::uint32_t WRITER = std::uint32_t(1) << 31;
+	
+	// Holds a stripe for writing while in scope, having first moved
+	// its chains into the next bucket array if the table is growing
+	struct WriteLock
+	{
+		WriteLock(ConcurrentSeparateChainingHashTable& table, size_t index)
+		: stripe(table._stripes[index])
+		{
+			_lock(stripe);
+			
+			try
+			{
+				table._move(stripe, index);
+			}
+			
+			catch (...)
+			{
+				_unlock(stripe);
+				
+				throw;
+			}
+		}
+		
+		WriteLock(const WriteLock&) = delete;
+		
+		WriteLock& operator=(const WriteLock&) = delete;
+		
+		~WriteLock()
+		{
+			_unlock(stripe);
+		}
+		
+		Stripe& stripe;
+	};
+	
+	// Holds the key's stripe for reading while in scope
+	struct ReadLock
+	{
+		ReadLock(const ConcurrentSeparateChainingHashTable& table, hash_t hash)
+		: stripe(table._lock_shared(hash))
+		{ }
+		
+		ReadLock(const ReadLock&) = delete;
+		
+		ReadLock& operator=(const ReadLock&) = delete;
+		
+		~ReadLock()
+		{
+			_unlock_shared(stripe);
+		}
+		
+		const Stripe& stripe;
+	};
+	
+	
+	static size_t _buckets(size_t buckets)
+	{
+		size_t power = STRIPES;
+		
+		while (power < buckets) power *= 2;
+		
+		return power;
+	}
+	
+	template<typename Lookup>
+	hash_t _hash(const Lookup& key) const
+	{
+		hash_t hash = _pre_hash(key);
+		
+		// The 64-bit finalizer of MurmurHash3
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccd;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53;
+		hash ^= hash >> 33;
+		
+		return hash;
+	}
+	
+	// Bucket arrays have at least as many buckets as there are stripes,
+	// and a power of two, so a bucket's stripe is the same in any of them
+	static size_t _stripe(hash_t hash)
+	{
+		return hash & (STRIPES - 1);
+	}
+	
+	Node* _search(Node* node, const Key& key) const
+	{
+		for ( ; node; node = node->next)
+		{
+			if (_key_equal(node->key, key)) return node;
+		}
+		
+		return nullptr;
+	}
+	
+	// Makes a bucket array twice the size of the given one, unless the
+	// table has grown past it already or is growing. The checks are made
+	// again under the first stripe's lock, which every growth starts under,
+	// so that they still hold when _next is set.
+	void _grow(const Table* table)
+	{
+		if (_next.load(std::memory_order_acquire) ||
+			_table.load(std::memory_order_acquire) != table)
+		{
+			return;
+		}
+		
+		WriteLock lock(*this, 0);
+		
+		if (_next.load(std::memory_order_acquire) ||
+			_table.load(std::memory_order_acquire) != table)
+		{
+			return;
+		}
+		
+		_next.store(new Table(table->buckets() * 2), std::memory_order_release);
+	}
+	
+	// Moves the chains of the next stripe in line, if the table is growing
+	void _help()
+	{
+		auto next = _next.load(std::memory_order_acquire);
+		
+		if (! next) return;
+		
+		auto index = next->handed_out.fetch_add(1, std::memory_order_relaxed);
+		
+		if (index >= STRIPES) return;
+		
+		// The growth may have ended meanwhile, which _move checks for
+		WriteLock lock(*this, index);
+	}
+	
+	// Moves the stripe's chains into the next bucket array, if the table
+	// is growing and they are not there yet. Called with the stripe locked.
+	// Throws nothing, unless the pre-hash does for a key it hashed before.
+	void _move(Stripe& stripe, size_t index)
+	{
+		auto next = _next.load(std::memory_order_acquire);
+		
+		if (! next || stripe.table == next) return;
+		
+		auto table = stripe.table;
+		
+		for (auto bucket = index; bucket < table->buckets(); bucket += STRIPES)
+		{
+			for (auto node = table->heads[bucket]; node; )
+			{
+				auto following = node->next;
+				
+				auto& head = next->bucket(_hash(node->key));
+				
+				node->next = head;
+				
+				head = node;
+				
+				node = following;
+			}
+			
+			table->heads[bucket] = nullptr;
+		}
+		
+		stripe.table = next;
+		
+		// The last stripe to move ends the growth. Readers that locked
+		// a stripe before it moved may still be in the old array, so it
+		// is kept until the destructor.
+		if (next->moved.fetch_add(1, std::memory_order_acq_rel) + 1 == STRIPES)
+		{
+			next->older = table;
+			
+			_table.store(next, std::memory_order_release);
+			
+			_next.store(nullptr, std::memory_order_release);
+		}
+	}
+	
+	static void _lock(Stripe& stripe)
+	{
+		auto& state = stripe.state;
+		
+		while (true)
+		{
+			auto current = state.load(std::memory_order_relaxed);
+			
+			if (! (current & WRITER) &&
+				state.compare_exchange_weak(current,
+											current | WRITER,
+											std::memory_order_acquire))
+			{
+				break;
+			}
+			
+			std::this_thread::yield();
+		}
+		
+		while (state.load(std::memory_order_acquire) != WRITER)
+		{
+			std::this_thread::yield();
+		}
+	}
+	
+	static void _unlock(Stripe& stripe)
+	{
+		stripe.state.store(0, std::memory_order_release);
+	}
+	
+	const Stripe& _lock_shared(hash_t hash) const
+	{
+		auto& stripe = _stripes[_stripe(hash)];
+		
+		auto& state = stripe.state;
+		
+		while (true)
+		{
+			auto current = state.load(std::memory_order_relaxed);
+			
+			if (! (current & WRITER) &&
+				state.compare_exchange_weak(current,
+											current + 1,
+											std::memory_order_acquire))
+			{
+				return stripe;
+			}
+			
+			std::this_thread::yield();
+		}
+	}
+	
+	static void _unlock_shared(const Stripe& stripe)
+	{
+		stripe.state.fetch_sub(1, std::memory_order_release);
+	}
+	
+	// Deletes every node, with all stripes locked or none in use
+	void _clear()
+	{
+		for (size_t index = 0; index < STRIPES; ++index)
+		{
+			auto& stripe = _stripes[index];
+			
+			auto table = stripe.table;
+			
+			for (auto bucket = index; bucket < table->buckets(); bucket += STRIPES)
+			{
+				for (auto node = table->heads[bucket]; node; )
+				{
+					auto next = node->next;
+					
+					delete node;
+					
+					node = next;
+				}
+				
+				table->heads[bucket] = nullptr;
+			}
+			
+			stripe.count.store(0, std::memory_order_relaxed);
+		}
+	}
+	
+	
+	pre_hash_t _pre_hash;
+	
+	key_equal_t _key_equal;
+	
+	size_t _load_factor;
+	
+	std::atomic<Table*> _table;
+	
+	// The bucket array the table is growing into, if it is
+	std::atomic<Table*> _next;
+	
+	CacheLineArray<Stripe> _stripes;
+};
+
+#endif /* CONCURRENT_SEPARATE_CHAINING_HASH_TABLE_HPP */
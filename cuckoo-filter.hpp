@@ -0,0 +1,400 @@
+#ifndef CUCKOO_FILTER_HPP
+#define CUCKOO_FILTER_HPP
+
+#include "cuckoo-hash-table.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// An approximate set, which only stores a fingerprint of each key in
+// one of its two buckets. contains() never misses a key that was
+// inserted, but may also claim keys that were not (at the rate given
+// by false_positive_rate()). Since a fingerprint's other bucket follows
+// from the fingerprint and its current bucket alone (partial-key cuckoo
+// hashing), fingerprints can be displaced and erased without the keys.
+// Only keys that were inserted may be erased, else the fingerprint of
+// another key may be erased instead.
+template<
+	typename Key,
+	typename Fingerprint = std::uint8_t,
+	std::size_t BucketSize = 4
+>
+class CuckooFilter
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	using pre_hash_t = std::function<size_t(const Key&)>;
+	
+	static const size_t MINIMUM_CAPACITY = 16;
+	
+	
+	CuckooFilter(size_t capacity = MINIMUM_CAPACITY,
+				 const pre_hash_t& pre_hash = std::hash<Key>())
+	: _size(0)
+	, _buckets(_round(capacity))
+	, _tables({{
+		fingerprints_t(_buckets * BucketSize),
+		fingerprints_t(_buckets * BucketSize)
+	}})
+	, _pre_hash(pre_hash)
+	{
+		_hash.generate(_buckets);
+	}
+	
+	CuckooFilter(const CuckooFilter& other)
+	: _size(other._size)
+	, _buckets(other._buckets)
+	, _tables(other._tables)
+	, _hash(other._hash)
+	, _pre_hash(other._pre_hash)
+	{ }
+	
+	CuckooFilter(CuckooFilter&& other) noexcept
+	: CuckooFilter()
+	{
+		swap(other);
+	}
+	
+	CuckooFilter& operator=(CuckooFilter other)
+	{
+		swap(other);
+		
+		return *this;
+	}
+	
+	void swap(CuckooFilter& other) noexcept
+	{
+		using std::swap;
+		
+		swap(_size, other._size);
+		
+		swap(_buckets, other._buckets);
+		
+		swap(_tables, other._tables);
+		
+		swap(_hash, other._hash);
+		
+		swap(_pre_hash, other._pre_hash);
+	}
+	
+	friend void swap(CuckooFilter& first, CuckooFilter& second) noexcept
+	{
+		first.swap(second);
+	}
+	
+	~CuckooFilter() = default;
+	
+	
+	// Returns false, leaving the filter unchanged, if it is full.
+	// Inserting a key again stores another copy of its fingerprint.
+	bool insert(const Key& key)
+	{
+		auto candidate = _candidate(key);
+		
+		for (auto index : {FIRST, SECOND})
+		{
+			auto bucket = _bucket(index, candidate);
+			
+			auto vacancies = _tables[index].match(bucket, EMPTY);
+			
+			if (vacancies)
+			{
+				auto slot = bucket + fingerprints_t::next(vacancies);
+				
+				_tables[index].set(slot, candidate.fingerprint);
+				
+				++_size;
+				
+				return true;
+			}
+		}
+		
+		return _displace(candidate);
+	}
+	
+	template<typename Itr>
+	void insert(Itr begin, Itr end)
+	{
+		for ( ; begin != end; ++begin)
+		{
+			insert(*begin);
+		}
+	}
+	
+	// Returns false if there was no such key
+	bool erase(const Key& key)
+	{
+		auto candidate = _candidate(key);
+		
+		for (auto index : {FIRST, SECOND})
+		{
+			auto bucket = _bucket(index, candidate);
+			
+			auto matches = _tables[index].match(bucket, candidate.fingerprint);
+			
+			if (matches)
+			{
+				auto slot = bucket + fingerprints_t::next(matches);
+				
+				_tables[index].set(slot, EMPTY);
+				
+				--_size;
+				
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	void clear()
+	{
+		for (auto& table : _tables) table.clear();
+		
+		_size = 0;
+	}
+	
+	
+	bool contains(const Key& key) const
+	{
+		auto candidate = _candidate(key);
+		
+		for (auto index : {FIRST, SECOND})
+		{
+			auto bucket = _bucket(index, candidate);
+			
+			if (_tables[index].match(bucket, candidate.fingerprint))
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	
+	size_t size() const
+	{
+		return _size;
+	}
+	
+	// The number of fingerprints the filter has room for
+	size_t capacity() const
+	{
+		return 2 * _buckets * BucketSize;
+	}
+	
+	bool is_empty() const
+	{
+		return _size == 0;
+	}
+	
+	double load_factor() const
+	{
+		return static_cast<double>(_size) / capacity();
+	}
+	
+	// How full the filter typically gets before an insert fails
+	static constexpr double max_load_factor()
+	{
+		return BucketSize == 1 ? 0.5 :
+			   BucketSize == 2 ? 0.84 :
+			   BucketSize < 8 ? 0.95 : 0.98;
+	}
+	
+	// The chance that contains() is true for a key that was never
+	// inserted, at the current load: each of the fingerprints in the
+	// two buckets matches with a chance of one in 2^bits - 1
+	double false_positive_rate() const
+	{
+		const double fingerprints = (1 << FINGERPRINT_BITS) - 1;
+		
+		const double compared = 2 * BucketSize * load_factor();
+		
+		return 1 - std::pow(1 - 1 / fingerprints, compared);
+	}
+	
+	// The memory per key inserted, not counting the few bytes of padding
+	double bits_per_item() const
+	{
+		if (_size == 0) return std::numeric_limits<double>::infinity();
+		
+		return static_cast<double>(FINGERPRINT_BITS * capacity()) / _size;
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+private:
+	
+	using fingerprints_t = Fingerprints<Fingerprint, BucketSize>;
+	
+	static const Fingerprint EMPTY = fingerprints_t::EMPTY;
+	
+	static const size_t FINGERPRINT_BITS = 8 * sizeof(Fingerprint);
+	
+	// The longest chain of displacements an insert may do
+	static const size_t CYCLE_LIMIT = 16;
+	
+	// The number of slots the search for a cuckoo path may visit
+	static const size_t SEARCH_LIMIT = 512;
+	
+	static const size_t NONE = static_cast<size_t>(-1);
+	
+	enum Index { FIRST, SECOND };
+	
+	
+	// A key's bucket in the first table and fingerprint
+	struct Candidate
+	{
+		size_t bucket;
+		
+		Fingerprint fingerprint;
+	};
+	
+	// A slot on a cuckoo path, along with the step before it
+	struct Step
+	{
+		Index index;
+		
+		size_t slot;
+		
+		size_t previous;
+		
+		size_t length;
+	};
+	
+	
+	Candidate _candidate(const Key& key) const
+	{
+		auto pre_hash = _pre_hash(key);
+		
+		return {_hash(pre_hash), fingerprints_t::of(pre_hash)};
+	}
+	
+	// The first slot of the candidate's bucket in either table
+	size_t _bucket(Index index, const Candidate& candidate) const
+	{
+		auto bucket = candidate.bucket;
+		
+		if (index == SECOND) bucket = _alternate(bucket, candidate.fingerprint);
+		
+		return bucket * BucketSize;
+	}
+	
+	// The bucket in the other table, by XOR with a hash of the
+	// fingerprint, so that each bucket is the other's alternate
+	size_t _alternate(size_t bucket, Fingerprint fingerprint) const
+	{
+		return (bucket ^ (static_cast<size_t>(fingerprint) * 0x5bd1e995)) & (_buckets - 1);
+	}
+	
+	// Searches breadth-first for the shortest chain of fingerprints
+	// to displace to free a slot in one of the candidate's buckets
+	bool _displace(const Candidate& candidate)
+	{
+		std::vector<Step> steps;
+		
+		for (auto index : {FIRST, SECOND})
+		{
+			auto bucket = _bucket(index, candidate);
+			
+			for (size_t slot = bucket; slot < bucket + BucketSize; ++slot)
+			{
+				steps.push_back({index, slot, NONE, 1});
+			}
+		}
+		
+		for (size_t i = 0; i < steps.size() && i < SEARCH_LIMIT; ++i)
+		{
+			auto step = steps[i];
+			
+			auto fingerprint = _tables[step.index][step.slot];
+			
+			auto other = (step.index == FIRST) ? SECOND : FIRST;
+			
+			auto bucket = _alternate(step.slot / BucketSize, fingerprint) * BucketSize;
+			
+			auto vacancies = _tables[other].match(bucket, EMPTY);
+			
+			if (vacancies)
+			{
+				auto slot = bucket + fingerprints_t::next(vacancies);
+				
+				_follow(steps, i, other, slot);
+				
+				_tables[other].set(slot, candidate.fingerprint);
+				
+				++_size;
+				
+				return true;
+			}
+			
+			if (step.length == CYCLE_LIMIT) continue;
+			
+			for (size_t slot = bucket; slot < bucket + BucketSize; ++slot)
+			{
+				steps.push_back({other, slot, i, step.length + 1});
+			}
+		}
+		
+		return false;
+	}
+	
+	// Moves the fingerprints along the path from the far end back,
+	// so that each one moves into a slot that was just vacated,
+	// leaving the index and slot at the start of the path
+	void _follow(const std::vector<Step>& steps,
+				 size_t last,
+				 Index& index,
+				 size_t& slot)
+	{
+		for (auto i = last; i != NONE; i = steps[i].previous)
+		{
+			auto& step = steps[i];
+			
+			_tables[index].set(slot, _tables[step.index][step.slot]);
+			
+			_tables[step.index].set(step.slot, EMPTY);
+			
+			index = step.index;
+			
+			slot = step.slot;
+		}
+	}
+	
+	static size_t _round(size_t capacity)
+	{
+		if (capacity < MINIMUM_CAPACITY) capacity = MINIMUM_CAPACITY;
+		
+		auto slots = static_cast<size_t>(std::ceil(capacity / max_load_factor()));
+		
+		auto buckets = (slots + 2 * BucketSize - 1) / (2 * BucketSize);
+		
+		return MultiplyShiftHash::round(buckets);
+	}
+	
+	
+	size_t _size;
+	
+	// The number of buckets in each table
+	size_t _buckets;
+	
+	std::array<fingerprints_t, 2> _tables;
+	
+	MultiplyShiftHash _hash;
+	
+	pre_hash_t _pre_hash;
+};
+
+#endif /* CUCKOO_FILTER_HPP */
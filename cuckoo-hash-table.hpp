@@ -1,31 +1,35 @@
 #ifndef CUCKOO_HASH_TABLE_HPP
 #define CUCKOO_HASH_TABLE_HPP
 
-template<typename Key, typename Value>
-class Table
+#include "pre-hash.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Keeps every item on the heap, the slots only hold
+// pointers. References to values stay valid until erased.
+struct PointerStorage
 {
-public:
-	
-	using size_t = std::size_t;
-	
-	struct Item
-	{
-		using hashes_t = std::pair<size_t, size_t>;
-		
-		Item(const hashes_t& h = hashes_t(),
-			 const Key& k = Key(),
-			 const Value& v = Value())
-		: key(k)
-		, value(v)
-		, hashes(h)
-		{ }
-		
-		Key key;
-		Value value;
-		
-		hashes_t hashes;
-	};
-	
+	template<typename Item>
 	class Data
 	{
 	public:
@@ -34,25 +38,35 @@ public:
 		
 		using data_t = item_ptr*;
 		
-		using iterator = const data_t;
+		// An item while it is not in a slot
+		using held_t = item_ptr;
 		
 		Data()
 		: _size(0)
+		, _extra(0)
 		, _items(nullptr)
 		{ }
 		
 		Data(size_t size, size_t extra = 0)
 		: _size(size)
 		, _extra(extra)
-		, _items(new item_ptr[_size + extra])
-		{ }
+		, _items(new item_ptr[_size + _extra])
+		{
+			std::fill(_items, _items + _size + _extra, nullptr);
+		}
 		
 		Data(const Data& other)
 		: _size(other._size)
 		, _extra(other._extra)
-		, _items(new item_ptr[_size])
+		, _items(new item_ptr[_size + _extra])
 		{
-			std::copy(other.begin(), other.end(), begin());
+			// The items are owned, so they must be copied too
+			for (size_t i = 0; i < _size + _extra; ++i)
+			{
+				auto item = other._items[i];
+				
+				_items[i] = item ? new Item(*item) : nullptr;
+			}
 		}
 		
 		Data(Data&& other) noexcept
@@ -86,22 +100,46 @@ public:
 		
 		~Data()
 		{
-			delete _items;
+			clear();
+			
+			delete [] _items;
+		}
+		
+		Item& operator[](size_t index) const
+		{
+			return *_items[index];
 		}
 		
-		item_ptr& operator[](size_t index) const
+		// Where the slot itself is, which only holds a pointer
+		const void* address(size_t index) const
 		{
-			return _items[index];
+			return _items + index;
+		}
+		
+		void put(size_t index, held_t&& item)
+		{
+			_items[index] = item;
+		}
+		
+		void exchange(size_t index, held_t& item)
+		{
+			std::swap(_items[index], item);
 		}
 		
-		iterator begin() const
+		held_t take(size_t index)
 		{
-			return _items;
+			auto item = _items[index];
+			
+			_items[index] = nullptr;
+			
+			return item;
 		}
 		
-		iterator end() const
+		void erase(size_t index)
 		{
-			return _items + _size;
+			delete _items[index];
+			
+			_items[index] = nullptr;
 		}
 		
 		size_t size() const
@@ -109,16 +147,30 @@ public:
 			return _size;
 		}
 		
+		size_t extra() const
+		{
+			return _extra;
+		}
+		
 		void clear()
 		{
-			for (auto& i : *this) delete i;
-			
-			for (size_t i = 0; i < _extra; ++i)
+			for (size_t i = 0; i < _size + _extra; ++i)
 			{
-				delete _items[_size + i];
+				erase(i);
 			}
 		}
 		
+		static Item& get(held_t& item)
+		{
+			return *item;
+		}
+		
+		template<typename... Args>
+		static held_t make(Args&&... args)
+		{
+			return new Item(std::forward<Args>(args)...);
+		}
+		
 	private:
 		
 		size_t _size;
@@ -127,101 +179,163 @@ public:
 		
 		data_t _items;
 	};
-	
-	using item_ptr = typename Data::item_ptr;
-	
-	using iterator = typename Data::iterator;
-	
-	using constants_t = std::array<size_t, 3>;
-	
-	
-	enum Constants { A, B, PRIME };
-	
-	
-	Table() = default;
-	
-	Table(size_t table_size)
-	: _data(table_size)
-	{
-		generate_constants();
-		nullify();
-	}
-	
-	Table(const Table& other)
-	: _data(other._data)
-	, _constants(other._constants)
-	{ }
-	
-	Table(Table&& other) noexcept
-	: Table()
-	{
-		swap(other);
-	}
-	
-	Table& operator=(Table other)
+};
+
+// Keeps the items in the slots themselves, so that probing a bucket
+// touches no other memory and inserting needs no allocation. Displacing
+// an item moves it, so references to values are only valid until the
+// next insert.
+struct InlineStorage
+{
+	template<typename Item>
+	class Data
 	{
-		swap(other);
+	public:
 		
-		return *this;
-	}
-	
-	void swap(Table& other) noexcept
-	{
-		using std::swap;
+		using held_t = Item;
 		
-		swap(_data, other._data);
+		Data()
+		: _size(0)
+		, _extra(0)
+		, _items(nullptr)
+		{ }
 		
-		swap(_constants, other._constants);
-	}
-	
-	friend void swap(Table& first, Table& second) noexcept
-	{
-		first.swap(second);
-	}
-	
-	~Table()
-	{
-		clear();
-	}
-	
-	iterator begin() const
-	{
-		return _data.begin();
-	}
-	
-	iterator end() const
-	{
-		return _data.end();
-	}
-	
-	item_ptr& front() const
-	{
-		return _data[0];
-	}
-	
-	item_ptr& back() const
-	{
-		return _data[size() - 1];
-	}
+		Data(size_t size, size_t extra = 0)
+		: _size(size)
+		, _extra(extra)
+		, _items(new Item[_size + _extra])
+		{ }
+		
+		Data(const Data& other)
+		: _size(other._size)
+		, _extra(other._extra)
+		, _items(new Item[_size + _extra])
+		{
+			std::copy(other._items, other._items + _size + _extra, _items);
+		}
+		
+		Data(Data&& other) noexcept
+		: Data()
+		{
+			swap(other);
+		}
+		
+		Data& operator=(Data other)
+		{
+			swap(other);
+			
+			return *this;
+		}
+		
+		void swap(Data& other) noexcept
+		{
+			using std::swap;
+			
+			swap(_size, other._size);
+			
+			swap(_extra, other._extra);
+			
+			swap(_items, other._items);
+		}
+		
+		friend void swap(Data& first, Data& second)
+		{
+			first.swap(second);
+		}
+		
+		~Data()
+		{
+			delete [] _items;
+		}
+		
+		Item& operator[](size_t index) const
+		{
+			return _items[index];
+		}
+		
+		const void* address(size_t index) const
+		{
+			return _items + index;
+		}
+		
+		void put(size_t index, held_t&& item)
+		{
+			_items[index] = std::move(item);
+		}
+		
+		void exchange(size_t index, held_t& item)
+		{
+			using std::swap;
+			
+			swap(_items[index], item);
+		}
+		
+		held_t take(size_t index)
+		{
+			held_t item = std::move(_items[index]);
+			
+			erase(index);
+			
+			return item;
+		}
+		
+		void erase(size_t index)
+		{
+			// Release whatever the key and value hold on to
+			_items[index] = Item();
+		}
+		
+		size_t size() const
+		{
+			return _size;
+		}
+		
+		size_t extra() const
+		{
+			return _extra;
+		}
+		
+		void clear()
+		{
+			std::fill(_items, _items + _size + _extra, Item());
+		}
+		
+		static Item& get(held_t& item)
+		{
+			return item;
+		}
+		
+		template<typename... Args>
+		static held_t make(Args&&... args)
+		{
+			return Item(std::forward<Args>(args)...);
+		}
+		
+	private:
+		
+		size_t _size;
+		
+		size_t _extra;
+		
+		Item* _items;
+	};
+};
+
+// Universal hashing modulo a random prime, which works
+// for any number of buckets but costs two divisions per hash
+class ModuloPrimeHash
+{
+public:
 	
-	item_ptr& operator[](size_t index) const
-	{
-		return _data[index];
-	}
+	using size_t = std::size_t;
 	
-	item_ptr& extra(size_t index = 0) const
-	{
-		return _data[size() + index];
-	}
 	
-	size_t hash(size_t pre_hash) const
+	static size_t round(size_t buckets)
 	{
-		size_t result = _constants[A] * pre_hash + _constants[B];
-		
-		return (result % _constants[PRIME]) % _data.size();
+		return buckets;
 	}
 	
-	void generate_constants()
+	void generate(size_t buckets)
 	{
 		using distribution_t = std::uniform_int_distribution<size_t>;
 		
@@ -234,41 +348,30 @@ public:
 		_constants[A] = distribution(generator);
 		_constants[B] = distribution(generator);
 		
+		// The prime must exceed the number of buckets, else
+		// the buckets above it are never hashed to at all
+		distribution_t primes(std::max<size_t>(1E6, buckets), 4E9);
+		
 		do
 		{
-			_constants[PRIME] = distribution(generator);
+			_constants[PRIME] = primes(generator);
 			
 		} while (! _is_prime(_constants[PRIME]));
-	}
-	
-	const Data& items() const
-	{
-		return _data;
-	}
-	
-	void reset(size_t new_size, size_t extra = 0)
-	{
-		_data = Data(new_size, extra);
 		
-		nullify();
+		_buckets = buckets;
 	}
 	
-	void nullify()
+	size_t operator()(size_t pre_hash) const
 	{
-		std::fill(begin(), end(), nullptr);
+		size_t result = _constants[A] * pre_hash + _constants[B];
+		
+		return (result % _constants[PRIME]) % _buckets;
 	}
 	
-	void clear()
-	{
-		_data.clear();
-	}
+private:
 	
-	size_t size() const
-	{
-		return _data.size();
-	}
+	enum Constants { A, B, PRIME };
 	
-private:
 	
 	static bool _is_prime(size_t value)
 	{
@@ -292,762 +395,2015 @@ private:
 	}
 	
 	
-	Data _data;
+	std::array<size_t, 3> _constants;
 	
-	constants_t _constants;
+	size_t _buckets;
 };
 
-template<typename Key, typename Value>
-class CuckooHashMap
+// Multiply-shift hashing onto a power-of-two number of buckets:
+// the seeded pre-hash is multiplied by a random odd constant and
+// the top bits of the product pick the bucket, without dividing
+class MultiplyShiftHash
 {
 public:
 	
-	struct Pair
+	using size_t = std::size_t;
+	
+	
+	// At least two buckets, so that the shift stays below 64
+	static size_t round(size_t buckets)
 	{
-		Pair(const Key& k, Value& v)
-		: key(k)
-		, value(v)
-		{ }
+		size_t power = 2;
 		
-		const Key& key;
-		Value& value;
-	};
+		while (power < buckets) power *= 2;
+		
+		return power;
+	}
+	
+	void generate(size_t buckets)
+	{
+		static std::random_device seed;
+		static std::mt19937_64 generator(seed());
+		
+		_seed = generator();
+		_multiplier = generator() | 1;
+		
+		_shift = 64;
+		
+		for (size_t power = 1; power < buckets; power *= 2) --_shift;
+	}
+	
+	size_t operator()(size_t pre_hash) const
+	{
+		std::uint64_t hash = pre_hash ^ _seed;
+		
+		// Fold the high bits down, since an input bit only
+		// affects the bits of the product at or above it
+		hash ^= hash >> 32;
+		
+		return (hash * _multiplier) >> _shift;
+	}
 	
 private:
 	
-	static const size_t CYCLE_LIMIT = 16;
+	std::uint64_t _seed;
+	std::uint64_t _multiplier;
 	
-	enum Index { FIRST, SECOND };
+	unsigned _shift;
+};
+
+// A fingerprint per slot of buckets of BucketSize slots, with zero
+// marking an empty slot, which can be compared a bucket at a time
+template<typename Fingerprint, std::size_t BucketSize>
+class Fingerprints
+{
+public:
 	
+	using size_t = std::size_t;
 	
-	using table_t = Table<Key, Value>;
+	// A bit per byte of a bucket's fingerprints
+	using mask_t = std::uint64_t;
 	
-	using container_t = std::array<table_t, 2>;
+	static const Fingerprint EMPTY = 0;
 	
-	using item_t = typename table_t::Item;
+	// Zeros past the end, so that the last bucket can be
+	// loaded 16 bytes at a time without reading past the end
+	static const size_t PADDING = 16 / sizeof(Fingerprint);
 	
-	using item_ptr = item_t*;
 	
+	Fingerprints() = default;
 	
-	class BaseIterator
+	Fingerprints(size_t slots)
+	: _fingerprints(slots + PADDING, EMPTY)
+	{ }
+	
+	Fingerprint operator[](size_t index) const
 	{
-	public:
+		return _fingerprints[index];
+	}
+	
+	void set(size_t index, Fingerprint fingerprint)
+	{
+		_fingerprints[index] = fingerprint;
+	}
+	
+	// Compares the fingerprints of the bucket starting at the slot
+	// with the given one, all at once where SSE2 is available.
+	// Matching against EMPTY finds the vacant slots.
+	mask_t match(size_t slot, Fingerprint fingerprint) const
+	{
+		return match(_fingerprints.data() + slot, fingerprint);
+	}
+	
+	// The same over a bucket anywhere in memory, followed
+	// by at least PADDING fingerprints of readable memory
+	static mask_t match(const Fingerprint* fingerprints, Fingerprint fingerprint)
+	{
+		mask_t mask = 0;
 		
-		BaseIterator()
-		: _tables(nullptr)
-		, _item(nullptr)
-		, _pair(nullptr)
-		{}
-		
-		BaseIterator(const container_t& tables, item_ptr& item)
-		: _tables(&tables)
-		, _item(&item)
-		, _pair(nullptr)
-		{ }
+#ifdef __SSE2__
 		
-		BaseIterator(const container_t& tables)
-		: _tables(&tables)
-		, _item(&tables[FIRST].front())
-		, _pair(nullptr)
-		{
-			--_item;
-			
-			// Find the next valid pointer; just sets back
-			// to the one passed if it was good
-			++*this;
-		}
+		auto bytes = reinterpret_cast<const char*>(fingerprints);
 		
-		virtual ~BaseIterator()
-		{
-			delete _pair;
-		}
+		const __m128i needle = (sizeof(Fingerprint) == 1) ?
+							   _mm_set1_epi8(static_cast<char>(fingerprint)) :
+							   _mm_set1_epi16(static_cast<short>(fingerprint));
 		
-		virtual BaseIterator& operator++()
+		for (size_t byte = 0; byte < BUCKET_BYTES; byte += 16)
 		{
-			do
-			{
-				if (++_item == (*_tables)[FIRST].end())
-				{
-					_item = (*_tables)[SECOND].begin();
-				}
-			}
-			
-			while (! *_item && _item < (*_tables)[SECOND].end());
+			auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + byte));
 			
-			_clear_pair();
+			auto equal = (sizeof(Fingerprint) == 1) ?
+						 _mm_cmpeq_epi8(chunk, needle) :
+						 _mm_cmpeq_epi16(chunk, needle);
 			
-			return *this;
+			mask |= static_cast<mask_t>(_mm_movemask_epi8(equal)) << byte;
 		}
 		
-		virtual BaseIterator operator++(int)
-		{
-			BaseIterator previous = *this;
-			
-			++*this;
-			
-			return previous;
-		}
+		// Keep one bit per fingerprint, and only those of the bucket
+		if (sizeof(Fingerprint) == 2) mask &= 0x5555555555555555;
+		
+		if (BUCKET_BYTES < 64) mask &= (mask_t(1) << (BUCKET_BYTES % 64)) - 1;
 		
-		virtual BaseIterator& operator--()
+#else
+		
+		for (size_t i = 0; i < BucketSize; ++i)
 		{
-			do
+			if (fingerprints[i] == fingerprint)
 			{
-				if (_item == (*_tables)[SECOND].begin())
-				{
-					_item = (*_tables)[FIRST].end() - 1;
-				}
-				
-				else --_item;
+				mask |= mask_t(1) << (i * sizeof(Fingerprint));
 			}
-			
-			while (! *_item && _item >= (*_tables)[FIRST].begin());
-			
-			_clear_pair();
-			
-			return *this;
-		}
-		
-		virtual BaseIterator operator--(int)
-		{
-			BaseIterator following = *this;
-			
-			--*this;
-			
-			return following;
 		}
 		
-		virtual bool operator==(const BaseIterator& other) const
-		{
-			return _item == other._item;
-		}
+#endif
 		
-		virtual bool operator!=(const BaseIterator& other) const
-		{
-			return _item != other._item;
-		}
+		return mask;
+	}
+	
+	void prefetch(size_t slot) const
+	{
+#ifdef __GNUC__
+		__builtin_prefetch(_fingerprints.data() + slot);
+#endif
+	}
+	
+	// Removes the first match from the mask and returns
+	// its offset from the start of the bucket
+	static size_t next(mask_t& mask)
+	{
+		auto bit = _lowest_bit(mask);
 		
+		mask &= mask - 1;
 		
-	protected:
+		return bit / sizeof(Fingerprint);
+	}
+	
+	// The top bits of a fixed multiplicative hash, so that
+	// an item keeps its fingerprint across rehashes
+	static Fingerprint of(size_t pre_hash)
+	{
+		static const size_t bits = 8 * sizeof(Fingerprint);
 		
-		void _check_pair()
-		{
-			if (! _pair)
-			{
-				_pair = new Pair((*_item)->key, (*_item)->value);
-			}
-		}
+		std::uint64_t hash = pre_hash * 0x9e3779b97f4a7c15;
 		
-		void _clear_pair()
-		{
-			if (_pair)
-			{
-				delete _pair;
-				
-				_pair = nullptr;
-			}
-		}
+		auto fingerprint = static_cast<Fingerprint>(hash >> (64 - bits));
 		
-		const container_t* _tables;
+		return (fingerprint == EMPTY) ? 1 : fingerprint;
+	}
+	
+	void clear()
+	{
+		std::fill(_fingerprints.begin(), _fingerprints.end(), EMPTY);
+	}
+	
+	size_t size() const
+	{
+		return _fingerprints.size() - PADDING;
+	}
+	
+private:
+	
+	static_assert(std::is_unsigned<Fingerprint>::value &&
+				  (sizeof(Fingerprint) == 1 || sizeof(Fingerprint) == 2),
+				  "Fingerprints must be 8- or 16-bit unsigned integers!");
+	
+	static const size_t BUCKET_BYTES = BucketSize * sizeof(Fingerprint);
+	
+	static_assert(BUCKET_BYTES <= 64, "Buckets can have at most 64 bytes of fingerprints!");
+	
+	
+	static size_t _lowest_bit(mask_t mask)
+	{
+#ifdef __GNUC__
+		return __builtin_ctzll(mask);
+#else
+		size_t bit = 0;
 		
-		item_ptr* _item;
+		for (; ! (mask & 1); mask >>= 1) ++bit;
 		
-		Pair* _pair;
-	};
+		return bit;
+#endif
+	}
+	
 	
+	std::vector<Fingerprint> _fingerprints;
+};
+
+template<typename Fingerprint, std::size_t BucketSize>
+const Fingerprint Fingerprints<Fingerprint, BucketSize>::EMPTY;
+
+template<typename Fingerprint, std::size_t BucketSize>
+const std::size_t Fingerprints<Fingerprint, BucketSize>::PADDING;
+
+template<
+	typename Key,
+	typename Value,
+	std::size_t BucketSize = 1,
+	typename Storage = PointerStorage,
+	typename HashPolicy = MultiplyShiftHash,
+	typename Fingerprint = std::uint8_t,
+	std::size_t Tables = 2
+>
+class Table
+{
 public:
 	
 	using size_t = std::size_t;
 	
-	using pre_hash_t = std::function<size_t(const Key&)>;
-	
-	static const size_t MINIMUM_CAPACITY = 16;
+	using fingerprints_t = Fingerprints<Fingerprint, BucketSize>;
 	
+	using mask_t = typename fingerprints_t::mask_t;
 	
-	struct ConstIterator : public BaseIterator
+	// The buckets of an item in each of the tables and its fingerprint
+	struct Hashes
 	{
+		std::array<size_t, Tables> buckets;
 		
-		using BaseIterator::_check_pair;
-		using BaseIterator::_item;
-		using BaseIterator::_pair;
-		
-		ConstIterator() = default;
-		
-		ConstIterator(const container_t& tables, item_ptr& item)
-		: BaseIterator(tables, item)
-		{ }
-		
-		ConstIterator(const container_t& tables)
-		: BaseIterator(tables)
-		{ }
-		
-		const Pair& operator*() const
-		{
-			_check_pair();
-			
-			return *_pair;
-		}
-		
-		const Pair* operator->() const
-		{
-			_check_pair();
-			
-			return _pair;
-		}
+		Fingerprint fingerprint;
 	};
 	
-	struct Iterator : public BaseIterator
+	struct Item
 	{
-		using BaseIterator::_check_pair;
-		using BaseIterator::_pair;
-		using BaseIterator::_tables;
-		using BaseIterator::_item;
-		
-		Iterator() = default;
-		
-		Iterator(const container_t& tables, item_ptr& item)
-		: BaseIterator(tables, item)
-		{ }
+		using hashes_t = Hashes;
 		
-		Iterator(const container_t& tables)
-		: BaseIterator(tables)
+		Item(const hashes_t& h = hashes_t(),
+			 const Key& k = Key(),
+			 const Value& v = Value())
+		: key(k)
+		, value(v)
+		, hashes(h)
 		{ }
 		
-		Pair& operator*()
-		{
-			_check_pair();
-			
-			return *_pair;
-		}
-		
-		Pair* operator->()
-		{
-			_check_pair();
-			
-			return _pair;
-		}
+		Key key;
+		Value value;
 		
-		operator ConstIterator() const
-		{
-			return {_tables, _item};
-		}
+		hashes_t hashes;
 	};
 	
+	using Data = typename Storage::template Data<Item>;
 	
-	CuckooHashMap(const pre_hash_t& pre_hash = std::hash<Key>(),
-				  size_t capacity = MINIMUM_CAPACITY)
-	: _size(0)
-	, _capacity(capacity)
-	, _pre_hash(pre_hash)
-	, _tables({
-		_capacity/2,
-		_capacity/2 + 1
-	})
+	using held_t = typename Data::held_t;
+	
+	
+	Table() = default;
+	
+	Table(size_t buckets, size_t extra = 0)
+	: _data(buckets * BucketSize, extra)
+	, _fingerprints(_data.size() + extra)
 	{
-		_tables[SECOND].extra() = new item_t;
+		generate_constants();
 	}
 	
-	CuckooHashMap(std::initializer_list<std::pair<Key, Value>> items,
-				  const pre_hash_t& pre_hash = std::hash<Key>(),
-				  size_t capacity = MINIMUM_CAPACITY)
-	: _size(0)
-	, _capacity(std::max(items.size(), capacity))
-	, _pre_hash(pre_hash)
-	, _tables({
-		_capacity/2,
-		_capacity/2 + 1
-	})
-	{ }
-	
-	CuckooHashMap(const CuckooHashMap& other)
-	: _size(other._size)
-	, _capacity(other._capacity)
-	, _pre_hash(other._pre_hash)
-	, _tables(other._tables)
+	Table(const Table& other)
+	: _data(other._data)
+	, _fingerprints(other._fingerprints)
+	, _hash(other._hash)
 	{ }
 	
-	CuckooHashMap(CuckooHashMap&& other) noexcept
-	: CuckooHashMap()
+	Table(Table&& other) noexcept
+	: Table()
 	{
 		swap(other);
 	}
 	
-	CuckooHashMap& operator=(CuckooHashMap other)
+	Table& operator=(Table other)
 	{
 		swap(other);
 		
 		return *this;
 	}
 	
-	void swap(CuckooHashMap& other) noexcept
+	void swap(Table& other) noexcept
 	{
 		using std::swap;
 		
-		swap(_size, other._size);
-		
-		swap(_capacity, other._capacity);
+		swap(_data, other._data);
 		
-		swap(_tables, other._tables);
+		swap(_fingerprints, other._fingerprints);
 		
-		swap(_pre_hash, other._pre_hash);
+		swap(_hash, other._hash);
 	}
 	
-	friend void swap(CuckooHashMap& first, CuckooHashMap& second)
+	friend void swap(Table& first, Table& second) noexcept
 	{
 		first.swap(second);
 	}
 	
-	~CuckooHashMap() = default;
+	~Table() = default;
 	
+	Item& operator[](size_t index) const
+	{
+		return _data[index];
+	}
 	
-	Iterator begin()
+	bool occupied(size_t index) const
 	{
-		return {_tables};
+		return _fingerprints[index] != fingerprints_t::EMPTY;
 	}
 	
-	Iterator end()
+	Fingerprint fingerprint(size_t index) const
 	{
-		return _iterator(_tables[SECOND].extra());
+		return _fingerprints[index];
 	}
 	
-	ConstIterator begin() const
+	// Compares the fingerprints of the bucket starting at the slot
+	// with the given one, so that keys are only compared on a match
+	mask_t match(size_t slot, Fingerprint fingerprint) const
 	{
-		return {_tables};
+		return _fingerprints.match(slot, fingerprint);
 	}
 	
-	ConstIterator end() const
+	// Hints the fingerprints and slots of the bucket
+	// starting at the slot into the cache
+	void prefetch(size_t slot) const
 	{
-		return _iterator(_tables[SECOND].extra());
+		_fingerprints.prefetch(slot);
+		
+#ifdef __GNUC__
+		auto begin = static_cast<const char*>(_data.address(slot));
+		auto end = static_cast<const char*>(_data.address(slot + BucketSize));
+		
+		for (; begin < end; begin += CACHE_LINE) __builtin_prefetch(begin);
+#endif
 	}
 	
-	Iterator insert(const Key& key, const Value& value)
+	static size_t next(mask_t& mask)
 	{
-		auto update = _try_update(key, value);
+		return fingerprints_t::next(mask);
+	}
+	
+	// The first of the BucketSize slots a hash maps to,
+	// which are adjacent so that a probe stays in cache
+	size_t bucket(size_t index) const
+	{
+		return index * BucketSize;
+	}
+	
+	void put(size_t index, held_t&& item)
+	{
+		_fingerprints.set(index, get(item).hashes.fingerprint);
 		
-		if (update.first != end()) return update.first;
+		_data.put(index, std::move(item));
+	}
+	
+	void exchange(size_t index, held_t& item)
+	{
+		_fingerprints.set(index, get(item).hashes.fingerprint);
 		
-		auto p_item = new item_t(update.second, key, value);
+		_data.exchange(index, item);
+	}
+	
+	held_t take(size_t index)
+	{
+		_fingerprints.set(index, fingerprints_t::EMPTY);
 		
-		return _insert(p_item);
+		return _data.take(index);
 	}
 	
-	Iterator insert(const Pair& pair)
+	void erase(size_t index)
 	{
-		return insert(pair.key, pair.value);
+		_fingerprints.set(index, fingerprints_t::EMPTY);
+		
+		_data.erase(index);
 	}
 	
-	template<typename Itr>
-	void insert(Itr begin, Itr end)
+	static Item& get(held_t& item)
 	{
-		for ( ; begin != end; ++begin)
+		return Data::get(item);
+	}
+	
+	template<typename... Args>
+	static held_t make(Args&&... args)
+	{
+		return Data::make(std::forward<Args>(args)...);
+	}
+	
+	size_t hash(size_t pre_hash) const
+	{
+		return _hash(pre_hash);
+	}
+	
+	void generate_constants()
+	{
+		_hash.generate(buckets());
+	}
+	
+	const HashPolicy& hash_policy() const
+	{
+		return _hash;
+	}
+	
+	const Data& items() const
+	{
+		return _data;
+	}
+	
+	void reset(size_t buckets, size_t extra = 0)
+	{
+		_data = Data(buckets * BucketSize, extra);
+		
+		_fingerprints = fingerprints_t(_data.size() + extra);
+	}
+	
+	void clear()
+	{
+		_data.clear();
+		
+		_fingerprints.clear();
+	}
+	
+	size_t size() const
+	{
+		return _data.size();
+	}
+	
+	// The number of slots past the end of the buckets
+	size_t extra() const
+	{
+		return _data.extra();
+	}
+	
+	size_t buckets() const
+	{
+		return _data.size() / BucketSize;
+	}
+	
+private:
+	
+	static const size_t CACHE_LINE = 64;
+	
+	
+	Data _data;
+	
+	fingerprints_t _fingerprints;
+	
+	HashPolicy _hash;
+};
+
+// The layout of the flat image CuckooHashMap::freeze() writes and
+// FrozenCuckooMap reads: a header, then for each table its hash
+// function, its fingerprints (padded like Fingerprints) and its slots,
+// each section starting on a cache line. The image holds the bytes of
+// the keys, values and hash functions as they are in memory, so it can
+// only be read on the same platform.
+template<typename Key, typename Value, typename HashPolicy, typename Fingerprint>
+struct FrozenImage
+{
+	using size_t = std::size_t;
+	
+	static const std::uint64_t MAGIC = 0x50414d4f4f4b4355; // "UCKOOMAP"
+	
+	static const std::uint64_t VERSION = 1;
+	
+	static const size_t ALIGNMENT = 64;
+	
+	static const size_t PADDING = 16;
+	
+	struct Header
+	{
+		std::uint64_t magic;
+		std::uint64_t version;
+		
+		// Of the types the image was written with
+		std::uint64_t key_size;
+		std::uint64_t value_size;
+		std::uint64_t hash_size;
+		std::uint64_t fingerprint_size;
+		
+		std::uint64_t bucket_size;
+		std::uint64_t tables;
+		
+		// The slots of each table, and past the last one's the stash's
+		std::uint64_t slots;
+		std::uint64_t stash;
+		
+		std::uint64_t size;
+	};
+	
+	struct Slot
+	{
+		Key key;
+		Value value;
+	};
+	
+	// Where a table's sections start, and where the next table may
+	struct Sections
+	{
+		size_t hash;
+		size_t fingerprints;
+		size_t slots;
+		size_t end;
+	};
+	
+	static size_t align(size_t offset)
+	{
+		return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	}
+	
+	static Sections sections(size_t offset, size_t slots)
+	{
+		Sections sections;
+		
+		sections.hash = align(offset);
+		
+		sections.fingerprints = align(sections.hash + sizeof(HashPolicy));
+		
+		auto fingerprints = slots * sizeof(Fingerprint) + PADDING;
+		
+		sections.slots = align(sections.fingerprints + fingerprints);
+		
+		sections.end = sections.slots + slots * sizeof(Slot);
+		
+		return sections;
+	}
+	
+	static_assert(std::is_trivially_copyable<Key>::value &&
+				  std::is_trivially_copyable<Value>::value,
+				  "Only maps of trivially copyable keys and values can be frozen!");
+	
+	static_assert(std::is_trivially_copyable<HashPolicy>::value,
+				  "The hash policy must be trivially copyable to be frozen!");
+};
+
+template<
+	typename Key,
+	typename Value,
+	std::size_t BucketSize = 1,
+	typename Storage = PointerStorage,
+	typename HashPolicy = MultiplyShiftHash,
+	typename Fingerprint = std::uint8_t,
+	std::size_t Tables = 2,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>
+>
+class CuckooHashMap
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	struct Pair
+	{
+		Pair(const Key& k, Value& v)
+		: key(k)
+		, value(v)
+		{ }
+		
+		const Key& key;
+		Value& value;
+	};
+	
+private:
+	
+	static_assert(BucketSize > 0, "Buckets must have at least one slot!");
+	
+	static_assert(Tables >= 2, "Cuckoo hashing needs at least two tables!");
+	
+	// The longest chain of displacements an insert may do
+	static const size_t CYCLE_LIMIT = 16;
+	
+	// The number of slots the search for a cuckoo path may visit
+	static const size_t SEARCH_LIMIT = 512;
+	
+	// Overflow slots for items for which no cuckoo path was found,
+	// kept as extra slots past the end of the last table
+	static const size_t STASH_SIZE = 4;
+	
+	// Rehashes with fresh constants before growing the table
+	static const size_t REHASH_LIMIT = 4;
+	
+	// The number of keys find_batch() prefetches at once
+	static const size_t BATCH_SIZE = 32;
+	
+	// The fewest slots worth a thread of their own in for_each()
+	static const size_t FOR_EACH_SHARE = 1 << 14;
+	
+	// The number of slots of the old tables each insert or erase
+	// moves on from while an incremental resize is under way
+	static const size_t MIGRATE_LIMIT = 32;
+	
+	static const size_t NONE = static_cast<size_t>(-1);
+	
+	// The table whose extra slots hold the stash
+	static const size_t LAST = Tables - 1;
+	
+	
+	using table_t = Table<Key, Value, BucketSize, Storage, HashPolicy, Fingerprint, Tables>;
+	
+	using container_t = std::array<table_t, Tables>;
+	
+	using item_t = typename table_t::Item;
+	
+	using held_t = typename table_t::held_t;
+	
+	
+	// Positions number the slots of each table in turn, the last one's
+	// followed by the stash, then likewise those of the old tables
+	// while a resize is under way, the end is one past. Dereferencing
+	// returns a Pair of references by value, so that iterating never
+	// allocates. Since there is no Pair in the map to refer to, these are
+	// input iterators as far as the standard goes, though they can go
+	// backwards, and range-for takes items by value or as auto&&.
+	template<typename Derived>
+	class BaseIterator
+	{
+	public:
+		
+		using iterator_category = std::input_iterator_tag;
+		
+		using difference_type = std::ptrdiff_t;
+		
+		using value_type = Pair;
+		
+		// What operator-> returns, holding the Pair it points to
+		template<typename P>
+		struct Arrow
+		{
+			P* operator->()
+			{
+				return &pair;
+			}
+			
+			P pair;
+		};
+		
+		BaseIterator()
+		: _map(nullptr)
+		, _position(0)
+		{ }
+		
+		BaseIterator(const CuckooHashMap& map, size_t position)
+		: _map(&map)
+		, _position(position)
+		{ }
+		
+		Derived& operator++()
+		{
+			_position = _map->_next(_position + 1);
+			
+			return _derived();
+		}
+		
+		Derived operator++(int)
+		{
+			Derived previous = _derived();
+			
+			++*this;
+			
+			return previous;
+		}
+		
+		Derived& operator--()
+		{
+			do --_position;
+			
+			while (_position > 0 && ! _map->_occupied(_position));
+			
+			return _derived();
+		}
+		
+		Derived operator--(int)
+		{
+			Derived following = _derived();
+			
+			--*this;
+			
+			return following;
+		}
+		
+		bool operator==(const BaseIterator& other) const
+		{
+			return _position == other._position;
+		}
+		
+		bool operator!=(const BaseIterator& other) const
+		{
+			return _position != other._position;
+		}
+		
+		
+	protected:
+		
+		Pair _get() const
+		{
+			auto& item = _map->_item(_position);
+			
+			return Pair(item.key, item.value);
+		}
+		
+		Derived& _derived()
+		{
+			return static_cast<Derived&>(*this);
+		}
+		
+		const CuckooHashMap* _map;
+		
+		size_t _position;
+	};
+	
+public:
+	
+	using pre_hash_t = Hash;
+	
+	using key_equal_t = KeyEqual;
+	
+	static const size_t MINIMUM_CAPACITY = 16;
+	
+	
+	struct ConstIterator : public BaseIterator<ConstIterator>
+	{
+		using pointer = typename BaseIterator<ConstIterator>::template Arrow<const Pair>;
+		
+		using reference = const Pair;
+		
+		using BaseIterator<ConstIterator>::_get;
+		
+		ConstIterator() = default;
+		
+		ConstIterator(const CuckooHashMap& map, size_t position)
+		: BaseIterator<ConstIterator>(map, position)
+		{ }
+		
+		const Pair operator*() const
+		{
+			return _get();
+		}
+		
+		pointer operator->() const
+		{
+			return {_get()};
+		}
+	};
+	
+	struct Iterator : public BaseIterator<Iterator>
+	{
+		using pointer = typename BaseIterator<Iterator>::template Arrow<Pair>;
+		
+		using reference = Pair;
+		
+		using BaseIterator<Iterator>::_get;
+		using BaseIterator<Iterator>::_map;
+		using BaseIterator<Iterator>::_position;
+		
+		Iterator() = default;
+		
+		Iterator(const CuckooHashMap& map, size_t position)
+		: BaseIterator<Iterator>(map, position)
+		{ }
+		
+		Pair operator*() const
+		{
+			return _get();
+		}
+		
+		pointer operator->() const
+		{
+			return {_get()};
+		}
+		
+		operator ConstIterator() const
+		{
+			return {*_map, _position};
+		}
+	};
+	
+	
+	CuckooHashMap(const pre_hash_t& pre_hash = pre_hash_t(),
+				  size_t capacity = MINIMUM_CAPACITY,
+				  const key_equal_t& key_equal = key_equal_t())
+	: _size(0)
+	, _capacity(0)
+	, _stashed(0)
+	, _migrated(0)
+	, _incremental(false)
+	, _pre_hash(pre_hash)
+	, _key_equal(key_equal)
+	{
+		_reset(capacity);
+	}
+	
+	CuckooHashMap(std::initializer_list<std::pair<Key, Value>> items,
+				  const pre_hash_t& pre_hash = pre_hash_t(),
+				  size_t capacity = MINIMUM_CAPACITY,
+				  const key_equal_t& key_equal = key_equal_t())
+	: CuckooHashMap(pre_hash, std::max(items.size() * 2, capacity), key_equal)
+	{
+		for (const auto& item : items)
+		{
+			insert(item.first, item.second);
+		}
+	}
+	
+	CuckooHashMap(const CuckooHashMap& other)
+	: _size(other._size)
+	, _capacity(other._capacity)
+	, _stashed(other._stashed)
+	, _tables(other._tables)
+	, _old(other._old)
+	, _migrated(other._migrated)
+	, _incremental(other._incremental)
+	, _pre_hash(other._pre_hash)
+	, _key_equal(other._key_equal)
+	{ }
+	
+	CuckooHashMap(CuckooHashMap&& other) noexcept
+	: CuckooHashMap()
+	{
+		swap(other);
+	}
+	
+	CuckooHashMap& operator=(CuckooHashMap other)
+	{
+		swap(other);
+		
+		return *this;
+	}
+	
+	void swap(CuckooHashMap& other) noexcept
+	{
+		using std::swap;
+		
+		swap(_size, other._size);
+		
+		swap(_capacity, other._capacity);
+		
+		swap(_stashed, other._stashed);
+		
+		swap(_tables, other._tables);
+		
+		swap(_old, other._old);
+		
+		swap(_migrated, other._migrated);
+		
+		swap(_incremental, other._incremental);
+		
+		swap(_pre_hash, other._pre_hash);
+		
+		swap(_key_equal, other._key_equal);
+	}
+	
+	friend void swap(CuckooHashMap& first, CuckooHashMap& second)
+	{
+		first.swap(second);
+	}
+	
+	~CuckooHashMap() = default;
+	
+	
+	Iterator begin()
+	{
+		return _iterator(_next(0));
+	}
+	
+	Iterator end()
+	{
+		return _iterator(_end());
+	}
+	
+	ConstIterator begin() const
+	{
+		return _iterator(_next(0));
+	}
+	
+	ConstIterator end() const
+	{
+		return _iterator(_end());
+	}
+	
+	Iterator insert(const Key& key, const Value& value)
+	{
+		_migrate();
+		
+		auto update = _try_update(key, value);
+		
+		if (update.first != NONE) return _iterator(update.first);
+		
+		auto item = table_t::make(update.second, key, value);
+		
+		return _iterator(_insert(key, std::move(item)));
+	}
+	
+	Iterator insert(const Pair& pair)
+	{
+		return insert(pair.key, pair.value);
+	}
+	
+	template<typename Itr>
+	void insert(Itr begin, Itr end)
+	{
+		for ( ; begin != end; ++begin)
+		{
+			insert(*begin);
+		}
+	}
+	
+	void erase(Iterator itr)
+	{
+		erase(itr->key);
+	}
+	
+	template<typename Itr>
+	void erase(Itr begin, Itr end)
+	{
+		for ( ; begin != end; ++begin)
+		{
+			erase(*begin);
+		}
+	}
+	
+	void erase(const Key& key)
+	{
+		if (! erase_if_found(key))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+	}
+	
+	bool erase_if_found(const Key& key)
+	{
+		_migrate();
+		
+		auto position = _lookup(key);
+		
+		if (position == NONE) return false;
+		
+		_erase(position);
+		
+		return true;
+	}
+	
+	void clear()
+	{
+		_reset(MINIMUM_CAPACITY);
+		
+		_old = container_t();
+		
+		_migrated = 0;
+		
+		_size = 0;
+	}
+	
+	
+	Value& at(const Key& key)
+	{
+		return _at(key);
+	}
+	
+	const Value& at(const Key& key) const
+	{
+		return _at(key);
+	}
+	
+	
+	bool contains(const Key& key) const
+	{
+		return _lookup(key) != NONE;
+	}
+	
+	Iterator find(const Key& key)
+	{
+		return _iterator(_find(key));
+	}
+	
+	ConstIterator find(const Key& key) const
+	{
+		return _iterator(_find(key));
+	}
+	
+	// Given a transparent pre-hash and key equality, these take any
+	// key they accept, such as a C string for a std::string key
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	Value& at(const Lookup& key)
+	{
+		return _at(key);
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	const Value& at(const Lookup& key) const
+	{
+		return _at(key);
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	bool contains(const Lookup& key) const
+	{
+		return _lookup(key) != NONE;
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	Iterator find(const Lookup& key)
+	{
+		return _iterator(_find(key));
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	ConstIterator find(const Lookup& key) const
+	{
+		return _iterator(_find(key));
+	}
+	
+	// Looks up the keys of a forward range, writing a pointer to
+	// each one's value (or nullptr) to the output. The keys are
+	// hashed and their buckets prefetched a group at a time before
+	// any are searched, so that their cache misses overlap.
+	template<typename Input, typename Output>
+	Output find_batch(Input first, Input last, Output output)
+	{
+		return _find_batch<Value*>(first, last, output);
+	}
+	
+	template<typename Input, typename Output>
+	Output find_batch(Input first, Input last, Output output) const
+	{
+		return _find_batch<const Value*>(first, last, output);
+	}
+	
+	// Calls the function with the key and value of every item, from up
+	// to the given number of threads, fewer for a small map. The slots
+	// are cut into even shares that do not straddle tables, so that
+	// outside an incremental resize, as many threads as tables take one
+	// table each. The function runs on many threads at once, and must
+	// neither throw nor modify the map.
+	template<typename Function>
+	void for_each(Function function,
+				  size_t threads = std::thread::hardware_concurrency())
+	{
+		_for_each<Value&>(function, threads);
+	}
+	
+	template<typename Function>
+	void for_each(Function function,
+				  size_t threads = std::thread::hardware_concurrency()) const
+	{
+		_for_each<const Value&>(function, threads);
+	}
+	
+	
+	Value& operator[](const Key& key)
+	{
+		_migrate();
+		
+		auto hashes = _hashes(key);
+		
+		auto position = _lookup(key, hashes);
+		
+		if (position == NONE)
+		{
+			position = _insert(key, table_t::make(hashes, key));
+		}
+		
+		return _item(position).value;
+	}
+	
+	std::pair<Iterator, bool> insert_or_assign(const Key& key, Value&& value)
+	{
+		_migrate();
+		
+		auto hashes = _hashes(key);
+		
+		auto position = _lookup(key, hashes);
+		
+		if (position != NONE)
+		{
+			_item(position).value = std::forward<Value>(value);
+			
+			return {end(), false};
+		}
+		
+		auto item = table_t::make(hashes, key, value);
+		
+		return {_iterator(_insert(key, std::move(item))), true};
+	}
+	
+	
+	size_t size() const
+	{
+		return _size;
+	}
+	
+	size_t capacity() const
+	{
+		return _capacity;
+	}
+	
+	bool is_empty() const
+	{
+		return _size == 0;
+	}
+	
+	double load_factor() const
+	{
+		return static_cast<double>(_size) / _capacity;
+	}
+	
+	// With a single slot per bucket and two tables, cuckoo hashing only
+	// works reliably up to 50% occupancy, while 4-way buckets or a third
+	// table (a third choice of bucket for every item) reach 90%
+	static constexpr double max_load_factor()
+	{
+		return Tables == 2 ? (BucketSize == 1 ? 0.5 :
+							  BucketSize == 2 ? 0.85 :
+							  BucketSize < 8 ? 0.9 : 0.95) :
+			   BucketSize == 1 ? (Tables == 3 ? 0.85 : 0.93) : 0.95;
+	}
+	
+	// When enabled, growing or shrinking keeps the old tables around
+	// and moves their items into the new ones a few slots at a time,
+	// with every insert or erase, rather than all at once. Lookups
+	// search both until then, but move nothing, so that they neither
+	// invalidate iterators nor write to a const map.
+	void incremental_resize(bool enabled)
+	{
+		if (! enabled) _migrate(NONE);
+		
+		_incremental = enabled;
+	}
+	
+	bool incremental_resize() const
+	{
+		return _incremental;
+	}
+	
+	// Writes the map to the stream as a FrozenImage, which holds no
+	// pointers, so that a FrozenCuckooMap can answer lookups from it
+	// where it lies, e.g. in a file mapped into memory. Finishes any
+	// incremental resize first. Keys and values must be trivially
+	// copyable.
+	void freeze(std::ostream& stream)
+	{
+		using image_t = FrozenImage<Key, Value, HashPolicy, Fingerprint>;
+		
+		using slot_t = typename image_t::Slot;
+		
+		_migrate(NONE);
+		
+		typename image_t::Header header = {
+			image_t::MAGIC,
+			image_t::VERSION,
+			sizeof(Key),
+			sizeof(Value),
+			sizeof(HashPolicy),
+			sizeof(Fingerprint),
+			BucketSize,
+			Tables,
+			_tables[0].size(),
+			STASH_SIZE,
+			_size
+		};
+		
+		std::vector<char> bytes(sizeof(header));
+		
+		std::memcpy(bytes.data(), &header, sizeof(header));
+		
+		for (auto& table : _tables)
+		{
+			auto slots = table.size() + table.extra();
+			
+			auto sections = image_t::sections(bytes.size(), slots);
+			
+			// The padding between and past the sections stays zero
+			bytes.resize(sections.end);
+			
+			std::memcpy(&bytes[sections.hash], &table.hash_policy(), sizeof(HashPolicy));
+			
+			auto fingerprints = &bytes[sections.fingerprints];
+			
+			for (size_t slot = 0; slot < slots; ++slot)
+			{
+				auto fingerprint = table.fingerprint(slot);
+				
+				std::memcpy(fingerprints + slot * sizeof(Fingerprint),
+							&fingerprint,
+							sizeof(Fingerprint));
+				
+				if (fingerprint == table_t::fingerprints_t::EMPTY) continue;
+				
+				auto& item = table[slot];
+				
+				new (&bytes[sections.slots + slot * sizeof(slot_t)]) slot_t{item.key, item.value};
+			}
+		}
+		
+		stream.write(bytes.data(), bytes.size());
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+	const key_equal_t& key_equal() const
+	{
+		return _key_equal;
+	}
+	
+	
+private:
+	
+	using hashes_t = typename table_t::Hashes;
+	
+	using update_t = std::pair<size_t, hashes_t>;
+	
+	using items_t = std::vector<held_t>;
+	
+	
+	Iterator _iterator(size_t position)
+	{
+		return {*this, position};
+	}
+	
+	ConstIterator _iterator(size_t position) const
+	{
+		return {*this, position};
+	}
+	
+	template<typename Lookup>
+	size_t _find(const Lookup& key) const
+	{
+		auto position = _lookup(key);
+		
+		return position == NONE ? _end() : position;
+	}
+	
+	template<typename Pointer, typename Input, typename Output>
+	Output _find_batch(Input first, Input last, Output output) const
+	{
+		std::array<hashes_t, BATCH_SIZE> hashes;
+		
+		while (first != last)
+		{
+			auto group = first;
+			
+			size_t count = 0;
+			
+			for (; first != last && count < BATCH_SIZE; ++first)
+			{
+				hashes[count++] = _hashes(*first);
+			}
+			
+			for (size_t i = 0; i < count; ++i)
+			{
+				for (size_t index = 0; index < Tables; ++index)
+				{
+					auto& table = _tables[index];
+					
+					table.prefetch(table.bucket(_hash(index, hashes[i])));
+				}
+			}
+			
+			for (size_t i = 0; i < count; ++i, ++group, ++output)
+			{
+				auto position = _lookup(*group, hashes[i]);
+				
+				if (position == NONE) *output = nullptr;
+				
+				else *output = static_cast<Pointer>(&_item(position).value);
+			}
+		}
+		
+		return output;
+	}
+	
+	template<typename Reference, typename Function>
+	void _for_each(Function& function, size_t threads) const
+	{
+		auto end = _end();
+		
+		threads = std::max<size_t>(1, std::min(threads, end / FOR_EACH_SHARE));
+		
+		std::vector<std::pair<size_t, size_t>> shares;
+		
+		size_t begin = 0;
+		
+		for (auto tables : {&_tables, &_old})
+		{
+			for (size_t index = 0; index < Tables; ++index)
+			{
+				auto& table = (*tables)[index];
+				
+				auto length = table.size() + (index == LAST ? table.extra() : 0);
+				
+				if (! length) continue;
+				
+				// Each table gets its part of the threads, rounded
+				auto count = std::max<size_t>(1, (length * threads + end / 2) / end);
+				
+				auto share = (length + count - 1) / count;
+				
+				for (auto last = begin + length; begin < last; begin = std::min(begin + share, last))
+				{
+					shares.emplace_back(begin, std::min(begin + share, last));
+				}
+			}
+		}
+		
+		std::atomic<size_t> taken(0);
+		
+		auto work = [this, &function, &shares, &taken]()
+		{
+			for (auto i = taken++; i < shares.size(); i = taken++)
+			{
+				_for_each_in<Reference>(function, shares[i].first, shares[i].second);
+			}
+		};
+		
+		std::vector<std::thread> workers;
+		
+		for (size_t i = 1; i < std::min(threads, shares.size()); ++i)
 		{
-			insert(*begin);
+			workers.emplace_back(work);
 		}
+		
+		// The calling thread takes shares as well
+		work();
+		
+		for (auto& worker : workers) worker.join();
 	}
 	
-	void erase(Iterator itr)
-	{
-		erase(itr->key);
-	}
-	
-	template<typename Itr>
-	void erase(Itr begin, Itr end)
+	template<typename Reference, typename Function>
+	void _for_each_in(Function& function, size_t position, size_t end) const
 	{
-		for ( ; begin != end; ++begin)
+		for (position = _next(position); position < end; position = _next(position + 1))
 		{
-			erase(*begin);
+			auto& item = _item(position);
+			
+			function(static_cast<const Key&>(item.key), static_cast<Reference>(item.value));
 		}
 	}
 	
-	void erase(const Key& key)
+	size_t _end() const
 	{
-		if (! erase_if_found(key))
-		{
-			throw std::invalid_argument("No such key!");
-		}
+		return _end(_tables) + _end(_old);
 	}
 	
-	bool erase_if_found(const Key& key)
+	// The first occupied position from the given one on, else the end
+	size_t _next(size_t position) const
 	{
-		auto hashes = _hashes(key);
+		auto end = _end();
 		
-		auto& first = _first(hashes.first);
-		
-		if (first && first->key == key)
+		while (position < end)
 		{
-			_erase(first);
+			auto slot = position;
 			
-			return true;
-		}
-		
-		auto& second = _second(hashes.second);
-		
-		if (second && second->key == key)
-		{
-			_erase(second);
+			auto& table = _table(slot);
 			
-			return true;
+			// Scans the rest of the table without locating each slot
+			for (; slot < table.size() + table.extra(); ++slot, ++position)
+			{
+				if (table.occupied(slot)) return position;
+			}
 		}
 		
-		return false;
-		
+		return end;
 	}
 	
-	void clear()
+	static size_t _end(const container_t& tables)
 	{
-		_capacity = MINIMUM_CAPACITY;
+		size_t end = tables[LAST].extra();
 		
-		for (auto& table : _tables) table.clear();
+		for (auto& table : tables) end += table.size();
 		
-		size_t table_size = _capacity/2;
+		return end;
+	}
+	
+	item_t& _item(size_t position) const
+	{
+		auto& table = _table(position);
 		
-		_tables[FIRST].reset(table_size);
-		_tables[SECOND].reset(table_size, 1);
+		return table[position];
+	}
+	
+	bool _occupied(size_t position) const
+	{
+		if (position >= _end()) return false;
 		
-		_tables[SECOND].extra() = new item_t;
+		auto& table = _table(position);
 		
-		_size = 0;
+		return table.occupied(position);
 	}
 	
-	
-	Value& at(const Key& key)
+	// The table a position lies in, leaving the slot within it
+	const table_t& _table(size_t& slot) const
 	{
-		return _at(key);
+		auto tables = &_tables;
+		
+		if (slot >= _end(_tables))
+		{
+			slot -= _end(_tables);
+			
+			tables = &_old;
+		}
+		
+		return (*tables)[_index(*tables, slot)];
 	}
 	
-	const Value& at(const Key& key) const
+	table_t& _table(size_t& slot)
 	{
-		return _at(key);
+		auto& map = static_cast<const CuckooHashMap&>(*this);
+		
+		return const_cast<table_t&>(map._table(slot));
 	}
 	
-	
-	bool contains(const Key& key) const
+	// The table a slot counted from the start of the tables lies in,
+	// leaving the slot within it, with the stash in the last table
+	static size_t _index(const container_t& tables, size_t& slot)
 	{
-		auto hashes = _hashes(key);
-		
-		auto first = _first(hashes.first);
+		size_t index = 0;
 		
-		if (first && first->key == key)
+		for (; index < LAST && slot >= tables[index].size(); ++index)
 		{
-			return true;
+			slot -= tables[index].size();
 		}
 		
-		auto second = _second(hashes.second);
+		return index;
+	}
+	
+	size_t _insert(const Key& key, held_t item)
+	{
+		if (! _cuckoo(item)) _rebuild(item);
 		
-		if (second && second->key == key)
+		if (++_size >= _capacity * max_load_factor())
 		{
-			return true;
+			_resize(_capacity * 2);
 		}
 		
-		return false;
+		return _lookup(key);
 	}
 	
-	Iterator find(const Key& key)
+	// Inserts the item into a free slot of one of its buckets,
+	// else displaces items along the shortest cuckoo path to make
+	// room, else puts it in the stash. Returns false when the stash
+	// is full too, leaving the item in the argument.
+	bool _cuckoo(held_t& item)
 	{
-		return _find(key);
+		auto& hashes = table_t::get(item).hashes;
+		
+		for (size_t index = 0; index < Tables; ++index)
+		{
+			auto slot = _vacancy(index, _hash(index, hashes));
+			
+			if (slot != NONE)
+			{
+				_tables[index].put(slot, std::move(item));
+				
+				return true;
+			}
+		}
+		
+		return _displace(item) || _stash(item);
 	}
 	
-	ConstIterator find(const Key& key) const
+	// A slot on a cuckoo path, along with the step before it
+	struct Step
 	{
-		return _find(key);
-	}
-	
+		size_t index;
+		size_t slot;
+		size_t previous;
+		size_t length;
+	};
 	
-	Value& operator[](const Key& key)
+	// Searches breadth-first for the shortest chain of displacements
+	// that frees a slot in one of the item's buckets. Nothing moves
+	// until a path is found, so failing leaves the tables untouched.
+	bool _displace(held_t& item)
 	{
-		try
+		std::vector<Step> steps;
+		
+		auto& hashes = table_t::get(item).hashes;
+		
+		for (size_t index = 0; index < Tables; ++index)
 		{
-			return _at(key);
+			auto bucket = _tables[index].bucket(_hash(index, hashes));
+			
+			for (size_t slot = bucket; slot < bucket + BucketSize; ++slot)
+			{
+				steps.push_back({index, slot, NONE, 1});
+			}
 		}
 		
-		catch(std::invalid_argument&)
+		for (size_t i = 0; i < steps.size() && i < SEARCH_LIMIT; ++i)
 		{
-			auto p_item = new item_t(_hashes(key), key);
+			auto step = steps[i];
+			
+			auto& occupant = _tables[step.index][step.slot].hashes;
 			
-			_insert(p_item);
+			// The occupant can move to its bucket in any other table
+			for (size_t other = 0; other < Tables; ++other)
+			{
+				if (other == step.index) continue;
+				
+				auto vacancy = _vacancy(other, _hash(other, occupant));
+				
+				if (vacancy != NONE)
+				{
+					_follow(steps, i, other, vacancy, item);
+					
+					return true;
+				}
+			}
+			
+			if (step.length == CYCLE_LIMIT) continue;
 			
-			return p_item->value;
+			for (size_t other = 0; other < Tables; ++other)
+			{
+				if (other == step.index) continue;
+				
+				auto bucket = _tables[other].bucket(_hash(other, occupant));
+				
+				for (size_t slot = bucket; slot < bucket + BucketSize; ++slot)
+				{
+					if (! _on_path(steps, i, other, slot))
+					{
+						steps.push_back({other, slot, i, step.length + 1});
+					}
+				}
+			}
 		}
+		
+		return false;
 	}
 	
-	std::pair<Iterator, bool> insert_or_assign(const Key& key, Value&& value)
+	// Performs the displacements from the far end of the path, where
+	// the free slot is, so that no item is ever without a slot
+	void _follow(const std::vector<Step>& steps,
+				 size_t last,
+				 size_t index,
+				 size_t vacancy,
+				 held_t& item)
 	{
-		try
+		for (auto i = last; i != NONE; i = steps[i].previous)
 		{
-			_at(key) = std::forward<Value>(value);
+			auto& step = steps[i];
 			
-			return {end(), false};
-		}
-		
-		catch(std::invalid_argument&)
-		{
-			auto iterator = _insert(new item_t(_hashes(key), key, value));
+			auto occupant = _tables[step.index].take(step.slot);
+			
+			_tables[index].put(vacancy, std::move(occupant));
 			
-			return {iterator, true};
+			index = step.index;
+			
+			vacancy = step.slot;
 		}
+		
+		_tables[index].put(vacancy, std::move(item));
 	}
 	
-	
-	size_t size() const
+	// A path visiting a slot twice would move the wrong items
+	static bool _on_path(const std::vector<Step>& steps,
+						 size_t last,
+						 size_t index,
+						 size_t slot)
 	{
-		return _size;
+		for (auto i = last; i != NONE; i = steps[i].previous)
+		{
+			if (steps[i].index == index && steps[i].slot == slot)
+			{
+				return true;
+			}
+		}
+		
+		return false;
 	}
 	
-	size_t capacity() const
+	bool _stash(held_t& item)
 	{
-		return _capacity;
+		auto& table = _tables[LAST];
+		
+		for (size_t slot = table.size(); slot < _stash_end(); ++slot)
+		{
+			if (! table.occupied(slot))
+			{
+				table.put(slot, std::move(item));
+				
+				++_stashed;
+				
+				return true;
+			}
+		}
+		
+		return false;
 	}
 	
-	bool is_empty() const
+	// Moves stashed items back into their buckets once there is room
+	void _unstash()
 	{
-		return _size == 0;
+		auto& table = _tables[LAST];
+		
+		for (size_t slot = table.size(); slot < _stash_end(); ++slot)
+		{
+			if (! table.occupied(slot)) continue;
+			
+			auto& hashes = table[slot].hashes;
+			
+			for (size_t index = 0; index < Tables; ++index)
+			{
+				auto vacancy = _vacancy(index, _hash(index, hashes));
+				
+				if (vacancy != NONE)
+				{
+					_tables[index].put(vacancy, table.take(slot));
+					
+					--_stashed;
+					
+					break;
+				}
+			}
+		}
 	}
 	
-	const pre_hash_t& pre_hash() const
+	size_t _stash_end() const
 	{
-		return _pre_hash;
+		return _tables[LAST].size() + STASH_SIZE;
 	}
 	
-	
-private:
-	
-	using hashes_t = std::pair<size_t, size_t>;
-	
-	using update_t = std::pair<Iterator, hashes_t>;
-	
-	using data_t = std::array<typename table_t::Data, 2>;
-	
-	
-	Iterator _iterator(item_ptr& p_item)
+	void _erase(size_t position)
 	{
-		return {_tables, p_item};
+		auto& table = _table(position);
+		
+		if (&table == &_tables[LAST] && position >= table.size())
+		{
+			--_stashed;
+		}
+		
+		table.erase(position);
+		
+		if (_stashed > 0) _unstash();
+		
+		if (--_size <= _capacity * max_load_factor() / 4)
+		{
+			_resize(_capacity / 2);
+		}
 	}
 	
-	ConstIterator _iterator(item_ptr& p_item) const
+	template<typename Lookup>
+	Value& _at(const Lookup& key) const
 	{
-		return {_tables, p_item};
+		auto position = _lookup(key);
+		
+		if (position == NONE) throw std::invalid_argument("No such key!");
+		
+		return _item(position).value;
 	}
 	
-	Iterator _find(const Key& key) const
+	update_t _try_update(const Key& key, const Value& value)
 	{
 		auto hashes = _hashes(key);
 		
-		auto first = _first(hashes.first);
-		
-		if (first && first->key == key)
-		{
-			return _iterator(first);
-		}
-		
-		auto second = _second(hashes.second);
+		auto position = _lookup(key, hashes);
 		
-		if (second && second->key == key)
-		{
-			return _iterator(second);
-		}
+		if (position != NONE) _item(position).value = value;
 		
-		return end();
+		return {position, hashes};
 	}
 	
-	Iterator _insert(item_ptr p_item)
+	template<typename Lookup>
+	size_t _lookup(const Lookup& key) const
 	{
-		size_t iterations = 0;
+		return _lookup(key, _hashes(key));
+	}
+	
+	template<typename Lookup>
+	size_t _lookup(const Lookup& key, const hashes_t& hashes) const
+	{
+		auto position = _lookup(_tables, hashes, key, _stashed > 0);
 		
-		auto& first = _first(p_item);
+		if (position != NONE || ! _migrating()) return position;
 		
-		std::swap(p_item, first);
+		// The old tables hash with constants of their own
+		position = _lookup(_old, _hashes(_old, key), key, true);
 		
-		auto iterator = _iterator(first);
+		return (position == NONE) ? NONE : _end(_tables) + position;
+	}
+	
+	template<typename Lookup>
+	size_t _lookup(const container_t& tables,
+				   const hashes_t& hashes,
+				   const Lookup& key,
+				   bool stashed) const
+	{
+		size_t offset = 0;
 		
-		while (p_item)
+		for (size_t index = 0; index < Tables; ++index)
 		{
-			if (++iterations > CYCLE_LIMIT)
+			auto slot = _search(tables, index, hashes, key);
+			
+			if (slot == NONE && index == LAST && stashed)
 			{
-				_rehash(_items());
-				
-				break;
+				slot = _search_stash(tables, hashes, key);
 			}
 			
-			std::swap(p_item, _second(p_item));
+			if (slot != NONE) return offset + slot;
 			
-			if (! p_item) break;
-			
-			std::swap(p_item, _first(p_item));
+			offset += tables[index].size();
 		}
 		
-		if (++_size == _capacity/2) _resize();
-		
-		return iterator;
+		return NONE;
 	}
 	
-	void _erase(item_ptr& p_item)
+	template<typename Lookup>
+	hashes_t _hashes(const Lookup& key) const
 	{
-		delete p_item;
-		
-		p_item = nullptr;
-		
-		if (--_size == _capacity/8) _resize();
+		return _hashes(_tables, key);
 	}
 	
-	Value& _at(const Key& key) const
+	template<typename Lookup>
+	hashes_t _hashes(const container_t& tables, const Lookup& key) const
 	{
-		auto hashes = _hashes(key);
+		size_t pre_hash = _pre_hash(key);
 		
-		auto& first = _first(hashes.first);
+		hashes_t hashes;
 		
-		if (first && first->key == key)
+		for (size_t index = 0; index < Tables; ++index)
 		{
-			return first->value;
+			hashes.buckets[index] = tables[index].hash(pre_hash);
 		}
 		
-		auto& second = _second(hashes.second);
-		
-		if (second && second->key == key)
-		{
-			return second->value;
-		}
+		hashes.fingerprint = table_t::fingerprints_t::of(pre_hash);
 		
-		throw std::invalid_argument("No such key!");
+		return hashes;
 	}
 	
-	update_t _try_update(const Key& key, const Value& value)
+	static size_t _hash(size_t index, const hashes_t& hashes)
 	{
-		auto hashes = _hashes(key);
+		return hashes.buckets[index];
+	}
+	
+	// Only compares the keys of slots with a matching fingerprint
+	template<typename Lookup>
+	size_t _search(const container_t& tables,
+				   size_t index,
+				   const hashes_t& hashes,
+				   const Lookup& key) const
+	{
+		auto& table = tables[index];
+		
+		auto bucket = table.bucket(_hash(index, hashes));
 		
-		auto& first = _first(hashes.first);
+		auto matches = table.match(bucket, hashes.fingerprint);
 		
-		if (first && first->key == key)
+		while (matches)
 		{
-			first->value = value;
+			auto slot = bucket + table_t::next(matches);
 			
-			return {_iterator(first), hashes};
+			if (_key_equal(table[slot].key, key)) return slot;
 		}
 		
-		auto& second = _second(hashes.second);
+		return NONE;
+	}
+	
+	template<typename Lookup>
+	size_t _search_stash(const container_t& tables,
+						 const hashes_t& hashes,
+						 const Lookup& key) const
+	{
+		auto& table = tables[LAST];
 		
-		if (second && second->key == key)
+		for (size_t slot = table.size(); slot < table.size() + table.extra(); ++slot)
 		{
-			second->value = value;
-			
-			return {_iterator(second), hashes};
+			if (table.fingerprint(slot) == hashes.fingerprint &&
+				_key_equal(table[slot].key, key))
+			{
+				return slot;
+			}
 		}
 		
-		return {end(), hashes};
+		return NONE;
 	}
 	
-	hashes_t _hashes(const Key& key) const
+	size_t _vacancy(size_t index, size_t hash) const
 	{
-		size_t pre_hash = _pre_hash(key);
+		auto& table = _tables[index];
+		
+		auto bucket = table.bucket(hash);
 		
-		size_t hash_1 = _tables[FIRST].hash(pre_hash);
-		size_t hash_2 = _tables[SECOND].hash(pre_hash);
+		auto vacancies = table.match(bucket, table_t::fingerprints_t::EMPTY);
 		
-		return {hash_1, hash_2};
+		return vacancies ? bucket + table_t::next(vacancies) : NONE;
 	}
 	
-	inline item_ptr& _first(const item_ptr item) const
+	// Moves all items out of the tables (without freeing them)
+	void _release(items_t& items)
 	{
-		return _first(item->hashes.first);
+		for (auto& table : _tables)
+		{
+			for (size_t slot = 0; slot < table.size() + table.extra(); ++slot)
+			{
+				if (table.occupied(slot))
+				{
+					items.push_back(table.take(slot));
+				}
+			}
+		}
+		
+		_stashed = 0;
 	}
 	
-	inline item_ptr& _second(const item_ptr item) const
+	static size_t _round(size_t capacity)
 	{
-		return _second(item->hashes.second);
+		return Tables * BucketSize * _buckets(capacity);
 	}
 	
-	inline item_ptr& _first(size_t hash) const
+	static size_t _buckets(size_t capacity)
 	{
-		return _tables[FIRST][hash];
+		size_t slots = capacity / Tables;
+		
+		auto buckets = std::max<size_t>(1, (slots + BucketSize - 1) / BucketSize);
+		
+		return HashPolicy::round(buckets);
 	}
 	
-	inline item_ptr& _second(size_t hash) const
+	size_t _buckets() const
 	{
-		return _tables[SECOND][hash];
+		return _buckets(_capacity);
 	}
 	
-	data_t _items()
+	void _reset(size_t capacity)
 	{
-		auto& first = _tables[FIRST].items();
-		auto& second = _tables[SECOND].items();
+		_capacity = _round(capacity);
+		
+		for (size_t index = 0; index < Tables; ++index)
+		{
+			_tables[index].reset(_buckets(), (index == LAST) ? STASH_SIZE : 0);
+			
+			_tables[index].generate_constants();
+		}
 		
-		return {first, second};
+		_stashed = 0;
 	}
 	
-	void _resize()
+	// Rehashes the tables along with an item for which there was no room
+	void _rebuild(held_t& item)
 	{
-		size_t new_capacity = _size * 4;
+		items_t items;
 		
-		if (new_capacity < MINIMUM_CAPACITY) return;
+		items.push_back(std::move(item));
 		
-		size_t old_capacity = _capacity;
+		_release(items);
+		
+		_rehash(items, _capacity);
+	}
+	
+	void _resize(size_t new_capacity)
+	{
+		if (new_capacity < MINIMUM_CAPACITY) return;
 		
-		_capacity = new_capacity;
+		if (_incremental)
+		{
+			// A resize still under way has to finish first
+			_migrate(NONE);
+			
+			_old.swap(_tables);
+			
+			_reset(new_capacity);
+			
+			return;
+		}
 		
-		auto old = _items();
+		items_t items;
 		
-		_tables[FIRST].reset(_capacity);
-		_tables[SECOND].reset(_capacity, 1);
+		items.reserve(_size);
 		
-		_rehash(std::move(old), old_capacity);
+		_release(items);
 		
-		_tables[SECOND].extra() = new item_t;
+		_rehash(items, new_capacity);
 	}
 	
-	void _rehash(data_t old, size_t old_capacity)
+	void _rehash(items_t& items, size_t capacity)
 	{
-		size_t old_table_size = old_capacity/2;
+		_reset(capacity);
 		
-		do
+		for (size_t attempts = 1; ! _try_rehash(items); ++attempts)
 		{
-			for (auto& table : _tables)
+			// Fresh constants keep failing, so the table is too full
+			if (attempts % REHASH_LIMIT == 0) _reset(_capacity * 2);
+			
+			else
 			{
-				table.nullify();
-				table.generate_constants();
+				for (auto& table : _tables) table.generate_constants();
 			}
-			
-		} while (! _try_rehash(old, old_table_size));
+		}
 	}
 	
-	bool _try_rehash(data_t old, size_t old_table_size)
+	bool _try_rehash(items_t& items)
 	{
-		for (auto& table : old)
+		for (size_t i = 0; i < items.size(); ++i)
 		{
-			for (auto& p_item : table)
+			auto& item = table_t::get(items[i]);
+			
+			item.hashes = _hashes(item.key);
+			
+			if (! _cuckoo(items[i]))
 			{
-				if (! p_item) continue;
+				// Keep the homeless item and gather
+				// everything back up for the next attempt
+				items.erase(items.begin(), items.begin() + i);
 				
-				p_item->hashes = _hashes(p_item->key);
+				_release(items);
 				
-				size_t iterations = 0;
-				
-				do
-				{
-					if (++iterations > CYCLE_LIMIT) return false;
-					
-					std::swap(p_item, _first(p_item));
-					
-					if (! p_item) break;
-					
-					std::swap(p_item, _second(p_item));
-					
-				} while(p_item);
+				return false;
 			}
 		}
 		
 		return true;
 	}
 	
-	void _rehash(data_t old)
+	bool _migrating() const
+	{
+		return _old[0].size() > 0;
+	}
+	
+	// Moves the items in the next slots of the old tables, up to the
+	// limit, into the new ones and frees the old tables once empty
+	void _migrate(size_t limit = MIGRATE_LIMIT)
 	{
-		_rehash(std::move(old), _capacity);
+		if (! _migrating()) return;
+		
+		auto end = _end(_old);
+		
+		for (; _migrated < end && limit > 0; ++_migrated, --limit)
+		{
+			auto slot = _migrated;
+			
+			auto index = _index(_old, slot);
+			
+			if (! _old[index].occupied(slot)) continue;
+			
+			auto item = _old[index].take(slot);
+			
+			auto& migrated = table_t::get(item);
+			
+			migrated.hashes = _hashes(migrated.key);
+			
+			if (! _cuckoo(item)) _rebuild(item);
+		}
+		
+		if (_migrated == end)
+		{
+			_old = container_t();
+			
+			_migrated = 0;
+		}
 	}
 	
 	
 	size_t _size;
 	size_t _capacity;
 	
+	size_t _stashed;
+	
 	container_t _tables;
 	
+	// The tables being moved out of during an incremental resize,
+	// up to the position of the next slot to move
+	container_t _old;
+	
+	size_t _migrated;
+	
+	bool _incremental;
+	
 	pre_hash_t _pre_hash;
+	
+	key_equal_t _key_equal;
 };
 
+// The map with a pre-hash chosen at run time, as it was before
+template<
+	typename Key,
+	typename Value,
+	std::size_t BucketSize = 1,
+	typename Storage = PointerStorage,
+	typename HashPolicy = MultiplyShiftHash,
+	typename Fingerprint = std::uint8_t,
+	std::size_t Tables = 2
+>
+using DynamicCuckooHashMap = CuckooHashMap<
+	Key,
+	Value,
+	BucketSize,
+	Storage,
+	HashPolicy,
+	Fingerprint,
+	Tables,
+	PreHashFunction<Key>
+>;
+
 #endif /* CUCKOO_HASH_TABLE_HPP */
\ No newline at end of file
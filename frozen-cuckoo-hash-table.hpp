@@ -0,0 +1,319 @@
+#ifndef FROZEN_CUCKOO_HASH_TABLE_HPP
+#define FROZEN_CUCKOO_HASH_TABLE_HPP
+
+#include "cuckoo-hash-table.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A read-only view of a CuckooHashMap that was written to a file with
+// freeze(), which answers lookups from the file mapped into memory
+// rather than loading it. Opening one takes constant time, and since
+// the pages are only read, any number of processes share them. The
+// template arguments must match those of the map that was frozen (else
+// the constructor throws), and the pre-hash must be the same function.
+template<
+	typename Key,
+	typename Value,
+	std::size_t BucketSize = 1,
+	typename HashPolicy = MultiplyShiftHash,
+	typename Fingerprint = std::uint8_t,
+	std::size_t Tables = 2,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>
+>
+class FrozenCuckooMap
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	using pre_hash_t = Hash;
+	
+	using key_equal_t = KeyEqual;
+	
+	
+	FrozenCuckooMap(const std::string& path,
+					const pre_hash_t& pre_hash = pre_hash_t(),
+					const key_equal_t& key_equal = key_equal_t())
+	: _image(nullptr)
+	, _bytes(0)
+	, _size(0)
+	, _stash(0)
+	, _pre_hash(pre_hash)
+	, _key_equal(key_equal)
+	{
+		_map(path);
+		
+		try
+		{
+			_read();
+		}
+		
+		catch (...)
+		{
+			_unmap();
+			
+			throw;
+		}
+	}
+	
+	FrozenCuckooMap(const FrozenCuckooMap& other) = delete;
+	
+	FrozenCuckooMap(FrozenCuckooMap&& other) noexcept
+	: _image(nullptr)
+	, _bytes(0)
+	, _size(0)
+	, _stash(0)
+	{
+		swap(other);
+	}
+	
+	FrozenCuckooMap& operator=(FrozenCuckooMap other) noexcept
+	{
+		swap(other);
+		
+		return *this;
+	}
+	
+	void swap(FrozenCuckooMap& other) noexcept
+	{
+		using std::swap;
+		
+		swap(_image, other._image);
+		
+		swap(_bytes, other._bytes);
+		
+		swap(_size, other._size);
+		
+		swap(_stash, other._stash);
+		
+		swap(_tables, other._tables);
+		
+		swap(_pre_hash, other._pre_hash);
+		
+		swap(_key_equal, other._key_equal);
+	}
+	
+	friend void swap(FrozenCuckooMap& first, FrozenCuckooMap& second) noexcept
+	{
+		first.swap(second);
+	}
+	
+	~FrozenCuckooMap()
+	{
+		_unmap();
+	}
+	
+	
+	const Value& at(const Key& key) const
+	{
+		auto value = find(key);
+		
+		if (! value) throw std::invalid_argument("No such key!");
+		
+		return *value;
+	}
+	
+	bool contains(const Key& key) const
+	{
+		return find(key) != nullptr;
+	}
+	
+	// A pointer to the key's value in the image, else nullptr
+	const Value* find(const Key& key) const
+	{
+		size_t pre_hash = _pre_hash(key);
+		
+		auto fingerprint = fingerprints_t::of(pre_hash);
+		
+		for (auto& table : _tables)
+		{
+			auto bucket = table.hash(pre_hash) * BucketSize;
+			
+			auto matches = fingerprints_t::match(table.fingerprints + bucket, fingerprint);
+			
+			while (matches)
+			{
+				auto& slot = table.slots[bucket + fingerprints_t::next(matches)];
+				
+				if (_key_equal(slot.key, key)) return &slot.value;
+			}
+		}
+		
+		auto& last = _tables[Tables - 1];
+		
+		for (size_t slot = last.size; slot < last.size + _stash; ++slot)
+		{
+			if (last.fingerprints[slot] == fingerprint &&
+				_key_equal(last.slots[slot].key, key))
+			{
+				return &last.slots[slot].value;
+			}
+		}
+		
+		return nullptr;
+	}
+	
+	
+	size_t size() const
+	{
+		return _size;
+	}
+	
+	bool is_empty() const
+	{
+		return _size == 0;
+	}
+	
+	// The size of the image, all of which is mapped
+	size_t bytes() const
+	{
+		return _bytes;
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+	const key_equal_t& key_equal() const
+	{
+		return _key_equal;
+	}
+	
+private:
+	
+	using image_t = FrozenImage<Key, Value, HashPolicy, Fingerprint>;
+	
+	using header_t = typename image_t::Header;
+	
+	using slot_t = typename image_t::Slot;
+	
+	using fingerprints_t = Fingerprints<Fingerprint, BucketSize>;
+	
+	// The sections of a table in the image
+	struct View
+	{
+		HashPolicy hash;
+		
+		const Fingerprint* fingerprints;
+		
+		const slot_t* slots;
+		
+		size_t size;
+	};
+	
+	
+	void _map(const std::string& path)
+	{
+		auto file = ::open(path.c_str(), O_RDONLY);
+		
+		if (file < 0) throw std::invalid_argument("Could not open the image!");
+		
+		struct stat status;
+		
+		if (::fstat(file, &status) == 0 && status.st_size > 0)
+		{
+			_bytes = status.st_size;
+			
+			auto image = ::mmap(nullptr, _bytes, PROT_READ, MAP_SHARED, file, 0);
+			
+			if (image != MAP_FAILED) _image = static_cast<const char*>(image);
+		}
+		
+		// The mapping stays valid once the file is closed
+		::close(file);
+		
+		if (! _image) throw std::invalid_argument("Could not map the image!");
+	}
+	
+	void _unmap()
+	{
+		if (_image) ::munmap(const_cast<char*>(_image), _bytes);
+		
+		_image = nullptr;
+	}
+	
+	void _read()
+	{
+		if (_bytes < sizeof(header_t)) _invalid();
+		
+		header_t header;
+		
+		std::memcpy(&header, _image, sizeof(header));
+		
+		if (header.magic != image_t::MAGIC ||
+			header.version != image_t::VERSION ||
+			header.key_size != sizeof(Key) ||
+			header.value_size != sizeof(Value) ||
+			header.hash_size != sizeof(HashPolicy) ||
+			header.fingerprint_size != sizeof(Fingerprint) ||
+			header.bucket_size != BucketSize ||
+			header.tables != Tables)
+		{
+			_invalid();
+		}
+		
+		_size = header.size;
+		
+		_stash = header.stash;
+		
+		size_t offset = sizeof(header);
+		
+		for (size_t index = 0; index < Tables; ++index)
+		{
+			auto& table = _tables[index];
+			
+			table.size = header.slots;
+			
+			auto slots = table.size + ((index == Tables - 1) ? _stash : 0);
+			
+			auto sections = image_t::sections(offset, slots);
+			
+			if (sections.end > _bytes) _invalid();
+			
+			// Copied out, since the image need not hold a valid object
+			std::memcpy(&table.hash, _image + sections.hash, sizeof(HashPolicy));
+			
+			table.fingerprints = reinterpret_cast<const Fingerprint*>(_image + sections.fingerprints);
+			
+			table.slots = reinterpret_cast<const slot_t*>(_image + sections.slots);
+			
+			offset = sections.end;
+		}
+	}
+	
+	static void _invalid()
+	{
+		throw std::invalid_argument("The image does not match the map's types!");
+	}
+	
+	
+	const char* _image;
+	
+	size_t _bytes;
+	
+	size_t _size;
+	
+	size_t _stash;
+	
+	std::array<View, Tables> _tables;
+	
+	pre_hash_t _pre_hash;
+	
+	key_equal_t _key_equal;
+};
+
+#endif /* FROZEN_CUCKOO_HASH_TABLE_HPP */
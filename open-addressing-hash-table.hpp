@@ -1,65 +1,846 @@
 #ifndef OPEN_ADDRESSING_HASH_TABLE_HPP
 #define OPEN_ADDRESSING_HASH_TABLE_HPP
 
+#include "pre-hash.hpp"
+
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The states of a run of slots, which a layout reports all at once:
+// bitmasks with a bit per slot from the first, of the live slots whose
+// key may be the one looked for (all of them, where the layout keeps
+// nothing of the hash), of the empty slots and of the dead ones
+struct SlotGroup
+{
+	std::uint32_t candidates;
+	std::uint32_t empty;
+	std::uint32_t dead;
+};
+
+// Keeps every entry in a node on the heap, the slots only hold
+// pointers. An erased entry stays behind as a dead node, which
+// probing passes over until the table is rebuilt.
+struct NodeLayout
+{
+	template<typename Key, typename Value>
+	class Data
+	{
+	public:
+		
+		using size_t = std::size_t;
+		
+		static const size_t GROUP_SIZE = 1;
+		
+		Data(size_t capacity = 0)
+		: _capacity(capacity)
+		, _nodes(new Node*[_capacity])
+		{
+			std::fill(_nodes, _nodes + _capacity, nullptr);
+		}
+		
+		Data(const Data& other)
+		: Data(other._capacity)
+		{
+			for (size_t i = 0; i < _capacity; ++i)
+			{
+				if (other._nodes[i]) _nodes[i] = new Node(*other._nodes[i]);
+			}
+		}
+		
+		Data(Data&& other) noexcept
+		: Data()
+		{
+			swap(other);
+		}
+		
+		Data& operator=(Data other)
+		{
+			swap(other);
+			
+			return *this;
+		}
+		
+		void swap(Data& other) noexcept
+		{
+			using std::swap;
+			
+			swap(_capacity, other._capacity);
+			
+			swap(_nodes, other._nodes);
+		}
+		
+		~Data()
+		{
+			for (size_t i = 0; i < _capacity; ++i) delete _nodes[i];
+			
+			delete [] _nodes;
+		}
+		
+		bool is_empty(size_t index) const
+		{
+			return ! _nodes[index];
+		}
+		
+		bool is_alive(size_t index) const
+		{
+			return _nodes[index] && _nodes[index]->is_alive;
+		}
+		
+		const Key& key(size_t index) const
+		{
+			return _nodes[index]->key;
+		}
+		
+		Value& value(size_t index) const
+		{
+			return _nodes[index]->value;
+		}
+		
+		SlotGroup group(size_t index, size_t) const
+		{
+			return {is_alive(index), is_empty(index), _nodes[index] && ! is_alive(index)};
+		}
+		
+		// A dead node in the slot is brought back rather than replaced
+		void put(size_t index, const Key& key, const Value& value, size_t)
+		{
+			if (_nodes[index]) *_nodes[index] = Node(key, value);
+			
+			else _nodes[index] = new Node(key, value);
+		}
+		
+		void erase(size_t index)
+		{
+			_nodes[index]->is_alive = false;
+		}
+		
+		// Moves a live entry into an empty slot of another array
+		void move(size_t index, Data& other, size_t slot)
+		{
+			other._nodes[slot] = _nodes[index];
+			
+			_nodes[index] = nullptr;
+		}
+		
+		// Frees a dead node, which leaves the slot empty
+		void clear(size_t index)
+		{
+			delete _nodes[index];
+			
+			_nodes[index] = nullptr;
+		}
+		
+		// Trades the entries of two live slots
+		void exchange(size_t index, size_t other)
+		{
+			std::swap(_nodes[index], _nodes[other]);
+		}
+		
+		size_t capacity() const
+		{
+			return _capacity;
+		}
+		
+	private:
+		
+		struct Node
+		{
+			Node(const Key& key_,
+				 const Value& value_ = Value(),
+				 bool is_alive_ = true)
+			: key(key_)
+			, value(value_)
+			, is_alive(is_alive_)
+			{ }
+			
+			Key key;
+			
+			Value value;
+			
+			bool is_alive;
+		};
+		
+		size_t _capacity;
+		
+		Node** _nodes;
+	};
+};
+
+// Keeps the keys and values in one contiguous array of slots, beside
+// an array of a state byte per slot, so that probing reads adjacent
+// memory rather than chasing a pointer per slot, and inserting does
+// not allocate. Keys and values must be default-constructible.
+struct FlatLayout
+{
+	template<typename Key, typename Value>
+	class Data
+	{
+	public:
+		
+		using size_t = std::size_t;
+		
+		static const size_t GROUP_SIZE = 1;
+		
+		Data(size_t capacity = 0)
+		: _capacity(capacity)
+		, _states(new std::uint8_t[_capacity])
+		, _slots(new Slot[_capacity])
+		{
+			std::fill(_states, _states + _capacity, EMPTY);
+		}
+		
+		Data(const Data& other)
+		: Data(other._capacity)
+		{
+			std::copy(other._states, other._states + _capacity, _states);
+			
+			std::copy(other._slots, other._slots + _capacity, _slots);
+		}
+		
+		Data(Data&& other) noexcept
+		: Data()
+		{
+			swap(other);
+		}
+		
+		Data& operator=(Data other)
+		{
+			swap(other);
+			
+			return *this;
+		}
+		
+		void swap(Data& other) noexcept
+		{
+			using std::swap;
+			
+			swap(_capacity, other._capacity);
+			
+			swap(_states, other._states);
+			
+			swap(_slots, other._slots);
+		}
+		
+		~Data()
+		{
+			delete [] _states;
+			
+			delete [] _slots;
+		}
+		
+		bool is_empty(size_t index) const
+		{
+			return _states[index] == EMPTY;
+		}
+		
+		bool is_alive(size_t index) const
+		{
+			return _states[index] == FULL;
+		}
+		
+		const Key& key(size_t index) const
+		{
+			return _slots[index].key;
+		}
+		
+		Value& value(size_t index) const
+		{
+			return _slots[index].value;
+		}
+		
+		SlotGroup group(size_t index, size_t) const
+		{
+			return {is_alive(index), is_empty(index), _states[index] == DELETED};
+		}
+		
+		void put(size_t index, const Key& key, const Value& value, size_t)
+		{
+			_slots[index].key = key;
+			
+			_slots[index].value = value;
+			
+			_states[index] = FULL;
+		}
+		
+		void erase(size_t index)
+		{
+			// Release whatever the key and value hold on to
+			_slots[index] = Slot();
+			
+			_states[index] = DELETED;
+		}
+		
+		void move(size_t index, Data& other, size_t slot)
+		{
+			other._slots[slot] = std::move(_slots[index]);
+			
+			other._states[slot] = FULL;
+			
+			_states[index] = EMPTY;
+		}
+		
+		// Empties a dead slot
+		void clear(size_t index)
+		{
+			_states[index] = EMPTY;
+		}
+		
+		void exchange(size_t index, size_t other)
+		{
+			using std::swap;
+			
+			swap(_slots[index], _slots[other]);
+		}
+		
+		size_t capacity() const
+		{
+			return _capacity;
+		}
+		
+	private:
+		
+		enum State : std::uint8_t { EMPTY, DELETED, FULL };
+		
+		struct Slot
+		{
+			Key key;
+			
+			Value value;
+		};
+		
+		size_t _capacity;
+		
+		std::uint8_t* _states;
+		
+		Slot* _slots;
+	};
+};
+
+// Like FlatLayout, but in the manner of SwissTable the byte per slot is
+// a control byte, which holds seven bits of a live entry's hash. Probing
+// compares the control bytes of sixteen slots with those seven bits at
+// once, using SSE2 where available, and only compares the keys of the
+// slots that match, of which there is rarely more than the one looked
+// for. The capacity must be at least GROUP_SIZE.
+struct SwissLayout
+{
+	template<typename Key, typename Value>
+	class Data
+	{
+	public:
+		
+		using size_t = std::size_t;
+		
+		static const size_t GROUP_SIZE = 16;
+		
+		Data(size_t capacity = 0)
+		: _capacity(capacity)
+		, _controls(new std::int8_t[_capacity + CLONES])
+		, _slots(new Slot[_capacity])
+		{
+			std::fill(_controls, _controls + _capacity + CLONES, EMPTY);
+		}
+		
+		Data(const Data& other)
+		: Data(other._capacity)
+		{
+			std::copy(other._controls, other._controls + _capacity + CLONES, _controls);
+			
+			std::copy(other._slots, other._slots + _capacity, _slots);
+		}
+		
+		Data(Data&& other) noexcept
+		: Data()
+		{
+			swap(other);
+		}
+		
+		Data& operator=(Data other)
+		{
+			swap(other);
+			
+			return *this;
+		}
+		
+		void swap(Data& other) noexcept
+		{
+			using std::swap;
+			
+			swap(_capacity, other._capacity);
+			
+			swap(_controls, other._controls);
+			
+			swap(_slots, other._slots);
+		}
+		
+		~Data()
+		{
+			delete [] _controls;
+			
+			delete [] _slots;
+		}
+		
+		bool is_empty(size_t index) const
+		{
+			return _controls[index] == EMPTY;
+		}
+		
+		bool is_alive(size_t index) const
+		{
+			return _controls[index] >= 0;
+		}
+		
+		const Key& key(size_t index) const
+		{
+			return _slots[index].key;
+		}
+		
+		Value& value(size_t index) const
+		{
+			return _slots[index].value;
+		}
+		
+		// The slots from the index on, wrapping around at the end
+		SlotGroup group(size_t index, size_t hash) const
+		{
+			auto controls = _controls + index;
+			
+			auto fragment = _fragment(hash);
+			
+#ifdef __GNUC__
+			// Which slot matches is only known once the control bytes
+			// are in, while the first is the likeliest, so it is fetched
+			// meanwhile rather than after
+			__builtin_prefetch(_slots + index);
+#endif
+
+#ifdef __SSE2__
+			
+			auto group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(controls));
+			
+			auto match = [&group] (std::int8_t control) -> std::uint32_t
+			{
+				return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(control)));
+			};
+			
+			return {match(fragment), match(EMPTY), match(DELETED)};
+			
+#else
+			
+			SlotGroup group = {0, 0, 0};
+			
+			for (size_t i = 0; i < GROUP_SIZE; ++i)
+			{
+				group.candidates |= std::uint32_t(controls[i] == fragment) << i;
+				group.empty |= std::uint32_t(controls[i] == EMPTY) << i;
+				group.dead |= std::uint32_t(controls[i] == DELETED) << i;
+			}
+			
+			return group;
+			
+#endif
+		}
+		
+		void put(size_t index, const Key& key, const Value& value, size_t hash)
+		{
+			_slots[index].key = key;
+			
+			_slots[index].value = value;
+			
+			_set(index, _fragment(hash));
+		}
+		
+		void erase(size_t index)
+		{
+			// Release whatever the key and value hold on to
+			_slots[index] = Slot();
+			
+			_set(index, DELETED);
+		}
+		
+		void move(size_t index, Data& other, size_t slot)
+		{
+			other._slots[slot] = std::move(_slots[index]);
+			
+			other._set(slot, _controls[index]);
+			
+			_set(index, EMPTY);
+		}
+		
+		void clear(size_t index)
+		{
+			_set(index, EMPTY);
+		}
+		
+		// The hash fragments go along with the entries
+		void exchange(size_t index, size_t other)
+		{
+			using std::swap;
+			
+			swap(_slots[index], _slots[other]);
+			
+			auto control = _controls[index];
+			
+			_set(index, _controls[other]);
+			
+			_set(other, control);
+		}
+		
+		size_t capacity() const
+		{
+			return _capacity;
+		}
+		
+	private:
+		
+		// Live slots' control bytes are their hash fragments instead
+		enum Control : std::int8_t { EMPTY = -128, DELETED = -2 };
+		
+		// The control bytes of the first slots are repeated past the
+		// end, so that a group can be loaded at once from any slot
+		static const size_t CLONES = GROUP_SIZE - 1;
+		
+		struct Slot
+		{
+			Key key;
+			
+			Value value;
+		};
+		
+		void _set(size_t index, std::int8_t control)
+		{
+			_controls[index] = control;
+			
+			if (index < CLONES) _controls[_capacity + index] = control;
+		}
+		
+		// The top seven bits of a multiplicative hash, so that
+		// they do not just repeat the bits that chose the slot
+		static std::int8_t _fragment(size_t hash)
+		{
+			std::uint64_t product = hash * 0x9e3779b97f4a7c15;
+			
+			return static_cast<std::int8_t>(product >> 57);
+		}
+		
+		size_t _capacity;
+		
+		std::int8_t* _controls;
+		
+		Slot* _slots;
+	};
+};
+
+// Keeps the slots inline like FlatLayout, in the order of Robin Hood
+// hashing: an entry being inserted takes the slot of any entry closer
+// to its home slot (the first of its probe sequence) than itself, and
+// that entry moves on in its place. Every probe sequence thus passes
+// entries in order of their distance from home, which keeps the longest
+// ones short even at high load, and lets a search stop as soon as it
+// meets an entry closer to home than the key would be. Erasing shifts
+// the entries after the slot back by one, rather than leaving a dead
+// entry, until one is in its home slot. Alongside each slot is the
+// distance of its entry from home, plus one, or zero if it is empty,
+// which fits in 32 bits as long as the capacity does.
+struct RobinHoodLayout
+{
+	template<typename Key, typename Value>
+	class Data
+	{
+	public:
+		
+		using size_t = std::size_t;
+		
+		static const size_t GROUP_SIZE = 1;
+		
+		struct Slot
+		{
+			Key key;
+			
+			Value value;
+		};
+		
+		Data(size_t capacity = 0)
+		: _capacity(capacity)
+		, _distances(new std::uint32_t[_capacity])
+		, _slots(new Slot[_capacity])
+		{
+			std::fill(_distances, _distances + _capacity, EMPTY);
+		}
+		
+		Data(const Data& other)
+		: Data(other._capacity)
+		{
+			std::copy(other._distances, other._distances + _capacity, _distances);
+			
+			std::copy(other._slots, other._slots + _capacity, _slots);
+		}
+		
+		Data(Data&& other) noexcept
+		: Data()
+		{
+			swap(other);
+		}
+		
+		Data& operator=(Data other)
+		{
+			swap(other);
+			
+			return *this;
+		}
+		
+		void swap(Data& other) noexcept
+		{
+			using std::swap;
+			
+			swap(_capacity, other._capacity);
+			
+			swap(_distances, other._distances);
+			
+			swap(_slots, other._slots);
+		}
+		
+		~Data()
+		{
+			delete [] _distances;
+			
+			delete [] _slots;
+		}
+		
+		bool is_empty(size_t index) const
+		{
+			return _distances[index] == EMPTY;
+		}
+		
+		bool is_alive(size_t index) const
+		{
+			return ! is_empty(index);
+		}
+		
+		// How many slots past its home slot the entry is
+		size_t distance(size_t index) const
+		{
+			return _distances[index] - 1;
+		}
+		
+		const Key& key(size_t index) const
+		{
+			return _slots[index].key;
+		}
+		
+		Value& value(size_t index) const
+		{
+			return _slots[index].value;
+		}
+		
+		Slot& slot(size_t index)
+		{
+			return _slots[index];
+		}
+		
+		// Puts the entry, at the given distance from its home, into the
+		// slot, which must be the first on its probe sequence that is
+		// empty or holds an entry closer to home. The entries from there
+		// on up to the next empty slot move on by one.
+		void insert(size_t index, Slot slot, size_t distance)
+		{
+			using std::swap;
+			
+			for ( ; ! is_empty(index); index = _next(index), ++distance)
+			{
+				auto resident = this->distance(index);
+				
+				if (resident < distance)
+				{
+					swap(_slots[index], slot);
+					
+					_set(index, distance);
+					
+					distance = resident;
+				}
+			}
+			
+			_slots[index] = std::move(slot);
+			
+			_set(index, distance);
+		}
+		
+		// Shifts the entries after the slot back, up to the first
+		// one in its home slot or an empty one
+		void erase(size_t index)
+		{
+			for (auto next = _next(index);
+				 ! is_empty(next) && distance(next) > 0;
+				 index = next, next = _next(next))
+			{
+				_slots[index] = std::move(_slots[next]);
+				
+				_distances[index] = _distances[next] - 1;
+			}
+			
+			// Release whatever the key and value hold on to
+			_slots[index] = Slot();
+			
+			_distances[index] = EMPTY;
+		}
+		
+		size_t capacity() const
+		{
+			return _capacity;
+		}
+		
+	private:
+		
+		enum : std::uint32_t { EMPTY = 0 };
+		
+		size_t _next(size_t index) const
+		{
+			return (index + 1 < _capacity) ? index + 1 : 0;
+		}
+		
+		void _set(size_t index, size_t distance)
+		{
+			_distances[index] = static_cast<std::uint32_t>(distance + 1);
+		}
+		
+		size_t _capacity;
+		
+		std::uint32_t* _distances;
+		
+		Slot* _slots;
+	};
+};
+
+template<typename Layout>
+struct is_robin_hood : std::false_type
+{ };
+
+template<>
+struct is_robin_hood<RobinHoodLayout> : std::true_type
+{ };
+
+// A probing policy gives the distance, in groups of slots, from one
+// probe of a sequence to the next, and whether it needs the number of
+// groups to be a power of two to reach every one of them (in which case
+// the capacity is rounded up to one). The step of a probe may be up to
+// the number of groups.
+
+// Probes consecutive groups, which makes the most of the cache, but
+// lets the sequences of nearby home slots run into each other
+struct LinearProbing
+{
+	static const bool POWER_OF_TWO = false;
+	
+	static std::size_t step(std::size_t, std::size_t, std::size_t)
+	{
+		return 1;
+	}
+};
 
-template<typename Key, typename Value>
+// Steps one group further each probe, so that the offsets from home are
+// the triangular numbers, which reach every group of a power of two.
+// Sequences from nearby home slots part after a few probes.
+struct QuadraticProbing
+{
+	static const bool POWER_OF_TWO = true;
+	
+	static std::size_t step(std::size_t, std::size_t probe, std::size_t)
+	{
+		return probe + 1;
+	}
+};
+
+// Steps by an odd number of groups taken from other bits of the hash,
+// which reaches every group of a power of two. Keys with the same home
+// slot but different hashes follow different sequences.
+struct DoubleHashing
+{
+	static const bool POWER_OF_TWO = true;
+	
+	static std::size_t step(std::size_t hash, std::size_t, std::size_t groups)
+	{
+		auto bits = (std::uint64_t(hash) * 0x9e3779b97f4a7c15) >> 32;
+		
+		return (bits | 1) & (groups - 1);
+	}
+};
+
+template<
+	typename Key,
+	typename Value,
+	typename Layout = NodeLayout,
+	typename Probing = LinearProbing,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>
+>
 class OpenAddressingHashTable
 {
 public:
 	
 	using size_t = std::size_t;
 	
-	using pre_hash_t = std::function<size_t(const Key&)>;
+	using pre_hash_t = Hash;
+	
+	using key_equal_t = KeyEqual;
 	
 	static const size_t minimum_capacity = 20;
 	
+	static_assert(! is_robin_hood<Layout>::value ||
+				  std::is_same<Probing, LinearProbing>::value,
+				  "Robin Hood hashing only works with linear probing");
+	
 	
 	OpenAddressingHashTable(size_t capacity = minimum_capacity,
-							const pre_hash_t& pre_hash = std::hash<Key>())
+							const pre_hash_t& pre_hash = pre_hash_t(),
+							const key_equal_t& key_equal = key_equal_t())
 	: _size(0)
-	, _capacity(capacity)
+	, _dead(0)
 	, _pre_hash(pre_hash)
-	, _nodes(new Node*[_capacity])
+	, _key_equal(key_equal)
+	, _data(_fit(std::max(capacity, minimum_capacity)))
+	{ }
+	
+	OpenAddressingHashTable(std::initializer_list<std::pair<Key, Value>> list,
+							size_t capacity = minimum_capacity,
+							const pre_hash_t& pre_hash = pre_hash_t(),
+							const key_equal_t& key_equal = key_equal_t())
+	: OpenAddressingHashTable(capacity, pre_hash, key_equal)
 	{
-		std::fill(_nodes, _nodes + _capacity, nullptr);
+		insert(list.begin(), list.end());
 	}
 	
-	OpenAddressingHashTable(std::initializer_list<std::pair<Key, Value>> list,
+	template<
+		typename Iterator,
+		typename = typename std::iterator_traits<Iterator>::iterator_category
+	>
+	OpenAddressingHashTable(Iterator first,
+							Iterator last,
 							size_t capacity = minimum_capacity,
-							const pre_hash_t& pre_hash = std::hash<Key>())
-	: _size(0)
-	, _capacity(std::max(capacity, list.size()))
-	, _pre_hash(pre_hash)
-	, _nodes(new Node*[_capacity])
+							const pre_hash_t& pre_hash = pre_hash_t(),
+							const key_equal_t& key_equal = key_equal_t())
+	: OpenAddressingHashTable(capacity, pre_hash, key_equal)
 	{
-		std::fill(_nodes, _nodes + _capacity, nullptr);
-		
-		for (const auto& item : list)
-		{
-			insert(item.first, item.second);
-		}
+		insert(first, last);
 	}
 	
 	OpenAddressingHashTable(const OpenAddressingHashTable& other)
-	: _size(0)
-	, _capacity(other._capacity)
+	: _size(other._size)
+	, _dead(other._dead)
 	, _pre_hash(other._pre_hash)
-	, _nodes(new Node*[other._capacity])
-	{
-		std::fill(_nodes, _nodes + _capacity, nullptr);
-		
-		for (size_t i = 0; i < other._capacity; ++i)
-		{
-			if (other._nodes[i] && other._nodes[i]->is_alive)
-			{
-				insert(other._nodes[i]->key,
-					   other._nodes[i]->key);
-			}
-		}
-	}
+	, _key_equal(other._key_equal)
+	, _data(other._data)
+	{ }
 	
 	OpenAddressingHashTable(OpenAddressingHashTable&& other) noexcept
 	: OpenAddressingHashTable()
@@ -78,13 +859,15 @@ public:
 	{
 		using std::swap;
 		
-		swap(_nodes, other._nodes);
+		swap(_data, other._data);
 		
 		swap(_size, other._size);
 		
-		swap(_capacity, other._capacity);
+		swap(_dead, other._dead);
 		
 		swap(_pre_hash, other._pre_hash);
+		
+		swap(_key_equal, other._key_equal);
 	}
 	
 	friend void swap(OpenAddressingHashTable& first,
@@ -93,34 +876,30 @@ public:
 		first.swap(second);
 	}
 	
-	~OpenAddressingHashTable()
-	{
-		_clear();
-	}
+	~OpenAddressingHashTable() = default;
 	
 	
 	void insert(const Key& key, const Value& value)
 	{
-		size_t index = 0;
-		
-		auto hash = _linear_hash(key, index);
+		auto hash = _pre_hash(key);
 		
-		for ( ; _nodes[hash]; hash = _linear_hash(key, ++index))
-		{
-			if (_nodes[hash]->key == key)
-			{
-				_nodes[hash]->value = value;
-				
-				return;
-			}
-		}
+		auto slot = _slot(key, hash);
 		
-		_nodes[hash] = new Node(key, value);
+		if (slot.second) _data.value(slot.first) = value;
 		
-		if (++_size == _capacity/2)
-		{
-			resize(_capacity * 2);
-		}
+		else _put(slot.first, key, value, hash);
+	}
+	
+	// Inserts or assigns each pair in the range. When the range can
+	// tell its length, the table makes room for all of it up front,
+	// rather than rehashing every time it fills up along the way.
+	template<
+		typename Iterator,
+		typename = typename std::iterator_traits<Iterator>::iterator_category
+	>
+	void insert(Iterator first, Iterator last)
+	{
+		_insert(first, last, typename std::iterator_traits<Iterator>::iterator_category());
 	}
 	
 	
@@ -136,79 +915,66 @@ public:
 	
 	bool contains(const Key& key) const
 	{
-		size_t index = 0;
-		
-		for (auto hash = _linear_hash(key, index);
-			 _nodes[hash];
-			 hash = _linear_hash(key, ++index))
-		{
-			if (_nodes[hash]->is_alive && _nodes[hash]->key == key)
-			{
-				return true;
-			}
-		}
-		
-		return false;
+		return _find(key) != NONE;
+	}
+	
+	// Given a transparent pre-hash and key equality, these take any
+	// key they accept, such as a C string for a std::string key
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	Value& get(const Lookup& key)
+	{
+		return _get(key);
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	const Value& get(const Lookup& key) const
+	{
+		return _get(key);
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	bool contains(const Lookup& key) const
+	{
+		return _find(key) != NONE;
 	}
 	
 	Value& operator[](const Key& key)
 	{
-		size_t index = 0;
+		auto hash = _pre_hash(key);
 		
-		auto hash = _linear_hash(key, index);
+		auto slot = _slot(key, hash);
 		
-		for ( ;_nodes[hash]; hash = _linear_hash(key, ++index))
-		{
-			if (_nodes[hash]->is_alive && _nodes[hash]->key == key)
-			{
-				return _nodes[hash]->value;
-			}
-		}
-		
-		_nodes[hash] = new Node(key);
-		
-		if (++_size == _capacity/2)
-		{
-			resize(_capacity * 2);
-		}
+		if (! slot.second) slot.first = _put(slot.first, key, Value(), hash);
 		
-		return _nodes[hash]->value;
+		return _data.value(slot.first);
 	}
 	
 	
 	void erase(const Key& key)
 	{
-		size_t index = 0;
+		auto slot = _find(key);
 		
-		for (auto hash = _linear_hash(key, index);
-			 _nodes[hash];
-			 hash = _linear_hash(key, ++index))
+		if (slot == NONE) throw std::invalid_argument("No such key!");
+		
+		_data.erase(slot);
+		
+		// Robin Hood hashing shifts entries back instead of leaving a dead one
+		if (! robin_hood_t::value) ++_dead;
+		
+		if (--_size <= _capacity() * max_load_factor() / 4 &&
+			_capacity() > _fit(minimum_capacity))
 		{
-			if (_nodes[hash]->is_alive && _nodes[hash]->key == key)
-			{
-				_nodes[hash]->is_alive = false;
-				
-				if (--_size == _capacity/8)
-				{
-					resize(_capacity/2);
-				}
-				
-				return;
-			}
+			_rehash(std::max(_capacity() / 2, minimum_capacity));
 		}
-		
-		throw std::invalid_argument("No such key!");
 	}
 	
 	void clear()
 	{
-		_clear();
-		
-		_capacity = minimum_capacity;
-		
-		_nodes = new Node*[_capacity];
+		_data = data_t(_fit(minimum_capacity));
 		
 		_size = 0;
+		
+		_dead = 0;
 	}
 	
 	
@@ -222,10 +988,59 @@ public:
 		return _size == 0;
 	}
 	
+	size_t capacity() const noexcept
+	{
+		return _capacity();
+	}
+	
+	double load_factor() const noexcept
+	{
+		return static_cast<double>(_size) / _capacity();
+	}
+	
+	// Robin Hood hashing keeps probe sequences short enough
+	// for linear probing to run at much higher occupancy
+	static constexpr double max_load_factor()
+	{
+		return is_robin_hood<Layout>::value ? 0.9 : 0.5;
+	}
+	
+	// The number of entries found by the first probe, the second and
+	// so on, up to the longest probe sequence. A probe reads a group
+	// of slots, which is a single slot for all but SwissLayout.
+	std::vector<size_t> probe_histogram() const
+	{
+		std::vector<size_t> histogram;
+		
+		for (size_t slot = 0; slot < _capacity(); ++slot)
+		{
+			if (! _data.is_alive(slot)) continue;
+			
+			auto hash = _pre_hash(_data.key(slot));
+			
+			auto first = _home(hash);
+			
+			size_t length = 1;
+			
+			for ( ; _offset(slot, _capacity() - first) >= GROUP_SIZE; ++length)
+			{
+				first = _next(first, hash, length - 1);
+			}
+			
+			if (length > histogram.size()) histogram.resize(length);
+			
+			++histogram[length - 1];
+		}
+		
+		return histogram;
+	}
+	
 	
 	void pre_hash(const pre_hash_t& pre_hash)
 	{
 		_pre_hash = pre_hash;
+		
+		_rehash(_capacity());
 	}
 	
 	const pre_hash_t& pre_hash() const noexcept
@@ -233,137 +1048,421 @@ public:
 		return _pre_hash;
 	}
 	
+	const key_equal_t& key_equal() const noexcept
+	{
+		return _key_equal;
+	}
+	
 	
+	// Makes room for the given number of entries, or the
+	// current number if more, at the maximum load factor
 	void resize(size_t new_size)
 	{
-		auto old = _nodes;
+		_rehash(_capacity_for(std::max(new_size, _size)));
+	}
+	
+	// Makes room for the given number of entries, so that inserting
+	// up to that many never rehashes. Unlike resize(), never shrinks.
+	void reserve(size_t new_size)
+	{
+		auto capacity = _fit(_capacity_for(new_size));
+		
+		if (capacity > _capacity()) _rehash(capacity);
+	}
+	
+	// Drops the dead entries and restores the shortest probe sequences,
+	// in place, unless the table uses Robin Hood hashing, which has no
+	// dead entries and keeps its probe sequences short as it goes
+	void rehash()
+	{
+		_compact(robin_hood_t());
+	}
+	
+private:
+	
+	using data_t = typename Layout::template Data<Key, Value>;
+	
+	using robin_hood_t = is_robin_hood<Layout>;
+	
+	// A slot, and whether it holds the key looked for
+	using slot_t = std::pair<size_t, bool>;
+	
+	static const size_t NONE = static_cast<size_t>(-1);
+	
+	// The number of slots whose states the layout reports at once
+	static const size_t GROUP_SIZE = data_t::GROUP_SIZE;
+	
+	
+	size_t _capacity() const
+	{
+		return _data.capacity();
+	}
+	
+	// The number of probes it takes to reach every slot
+	size_t _groups() const
+	{
+		return (_capacity() + GROUP_SIZE - 1) / GROUP_SIZE;
+	}
+	
+	// The capacity that holds the number of entries below the maximum
+	// load factor, since the table grows once it reaches it
+	static size_t _capacity_for(size_t size)
+	{
+		return std::max<size_t>(size / max_load_factor() + 1, minimum_capacity);
+	}
+	
+	// The capacity rounded up to what the probing policy can cover
+	static size_t _fit(size_t capacity)
+	{
+		if (! Probing::POWER_OF_TWO) return capacity;
 		
-		auto old_capacity = _capacity;
+		// The group size is a power of two itself
+		size_t power = GROUP_SIZE;
 		
-		_size = new_size;
+		while (power < capacity) power *= 2;
 		
-		_capacity = new_size * 2;
+		return power;
+	}
+	
+	// The first slot of the probe sequence
+	size_t _home(size_t hash) const
+	{
+		if (Probing::POWER_OF_TWO) return hash & (_capacity() - 1);
 		
-		_nodes = new Node*[_capacity];
+		return hash % _capacity();
+	}
+	
+	// The first slot of the group after the given probe
+	size_t _next(size_t first, size_t hash, size_t probe) const
+	{
+		return _offset(first, GROUP_SIZE * Probing::step(hash, probe, _groups()));
+	}
+	
+	// The slot holding the key, else the one to insert it into
+	template<typename Lookup>
+	slot_t _slot(const Lookup& key, size_t hash) const
+	{
+		return _slot(key, hash, robin_hood_t());
+	}
+	
+	// Without Robin Hood hashing, the slot to insert into is the first
+	// free one on the probe sequence, preferring a dead one over the
+	// empty one. The table is at most half full, so there is always
+	// a free slot. The layout reports the states of a group of
+	// consecutive slots at a time, and each probe reads a group.
+	template<typename Lookup>
+	slot_t _slot(const Lookup& key, size_t hash, std::false_type) const
+	{
+		auto free = NONE;
 		
-		std::fill(_nodes, _nodes + _capacity, nullptr);
+		auto first = _home(hash);
 		
-		_rehash(old, old_capacity);
+		for (size_t probe = 0; probe < _groups(); first = _next(first, hash, probe++))
+		{
+			auto group = _data.group(first, hash);
+			
+			// The probe sequence ends at the first empty slot
+			auto end = group.empty ? _lowest_bit(group.empty) : GROUP_SIZE;
+			
+			std::uint32_t before_end = (std::uint64_t(1) << end) - 1;
+			
+			for (auto candidates = group.candidates & before_end;
+				 candidates;
+				 candidates &= candidates - 1)
+			{
+				auto slot = _offset(first, _lowest_bit(candidates));
+				
+				if (_key_equal(_data.key(slot), key)) return {slot, true};
+			}
+			
+			auto dead = group.dead & before_end;
+			
+			if (free == NONE && dead) free = _offset(first, _lowest_bit(dead));
+			
+			if (group.empty)
+			{
+				return {(free == NONE) ? _offset(first, end) : free, false};
+			}
+		}
 		
-		delete [] old;
+		return {free, false};
 	}
 	
-	void rehash()
+	// With Robin Hood hashing, the search ends at the first slot that
+	// is empty or holds an entry closer to home than the key would be,
+	// which is also where the key belongs. There is always an empty slot.
+	template<typename Lookup>
+	slot_t _slot(const Lookup& key, size_t hash, std::true_type) const
+	{
+		auto slot = _home(hash);
+		
+		for (size_t distance = 0; ; ++distance, slot = _offset(slot, 1))
+		{
+			if (_data.is_empty(slot) || _data.distance(slot) < distance)
+			{
+				return {slot, false};
+			}
+			
+			if (_data.distance(slot) == distance && _key_equal(_data.key(slot), key))
+			{
+				return {slot, true};
+			}
+		}
+	}
+	
+	template<typename Lookup>
+	size_t _find(const Lookup& key) const
+	{
+		auto slot = _slot(key, _pre_hash(key));
+		
+		return slot.second ? slot.first : NONE;
+	}
+	
+	template<typename Iterator>
+	void _insert(Iterator first, Iterator last, std::forward_iterator_tag)
+	{
+		reserve(_size + std::distance(first, last));
+		
+		_insert(first, last, std::input_iterator_tag());
+	}
+	
+	template<typename Iterator>
+	void _insert(Iterator first, Iterator last, std::input_iterator_tag)
+	{
+		for ( ; first != last; ++first)
+		{
+			insert(first->first, first->second);
+		}
+	}
+	
+	// Returns the slot the entry ends up in
+	size_t _put(size_t slot, const Key& key, const Value& value, size_t hash)
 	{
-		auto old = _nodes;
+		_place(slot, key, value, hash, robin_hood_t());
 		
-		_nodes = new Node*[_capacity];
+		if (++_size >= _capacity() * max_load_factor())
+		{
+			_rehash(_capacity() * 2);
+			
+			return _find(key);
+		}
 		
-		std::fill(_nodes, _nodes + _capacity, nullptr);
+		// Once dead entries take up the rest of the room, they are dropped
+		// in place, unless live ones take up over 7/8 of it. Only then does
+		// the table grow, so churn at a steady size needs no more memory.
+		if (_size + _dead >= _capacity() * max_load_factor())
+		{
+			if (_size * 8 <= _capacity() * max_load_factor() * 7) _compact(robin_hood_t());
+			
+			else _rehash(_capacity() * 2);
+			
+			return _find(key);
+		}
 		
-		_rehash(old, _capacity);
+		return slot;
 	}
 	
-private:
+	void _place(size_t slot,
+				const Key& key,
+				const Value& value,
+				size_t hash,
+				std::false_type)
+	{
+		if (! _data.is_empty(slot)) --_dead;
+		
+		_data.put(slot, key, value, hash);
+	}
+	
+	void _place(size_t slot,
+				const Key& key,
+				const Value& value,
+				size_t hash,
+				std::true_type)
+	{
+		_data.insert(slot, {key, value}, _distance(slot, hash));
+	}
 	
-	struct Node
+	// Moves the live entries into a new array, leaving the dead behind
+	void _rehash(size_t capacity)
 	{
-		Node(const Key& key_,
-			 const Value& value_ = Value(),
-			 bool is_alive_ = true)
-		: key(key_)
-		, value(value_)
-		, is_alive(is_alive_)
-		{ }
+		data_t old(_fit(capacity));
 		
-		Key key;
+		old.swap(_data);
 		
-		Value value;
+		_dead = 0;
 		
-		bool is_alive;
-	};
+		for (size_t i = 0; i < old.capacity(); ++i)
+		{
+			if (old.is_alive(i)) _move(old, i, robin_hood_t());
+		}
+	}
 	
-	void _rehash(Node** old, size_t old_capacity)
+	// Rehashes without a new array, in the manner of SwissTable's "drop
+	// deletes without resize": dead slots become empty, then every live
+	// entry moves to the first slot on its probe sequence that is empty or
+	// holds an entry yet to move, trading places with the latter. Entries
+	// that have moved stay put, so no slot before them on their probe
+	// sequences ever becomes empty again. On top of the table this takes
+	// a bit per slot, for the entries yet to move.
+	void _compact(std::false_type)
 	{
-		for (size_t i = 0; i < old_capacity; ++i)
+		std::vector<bool> pending(_capacity());
+		
+		for (size_t slot = 0; slot < _capacity(); ++slot)
+		{
+			if (_data.is_alive(slot)) pending[slot] = true;
+			
+			else if (! _data.is_empty(slot)) _data.clear(slot);
+		}
+		
+		_dead = 0;
+		
+		for (size_t slot = 0; slot < _capacity(); ++slot)
 		{
-			if (old[i] && old[i]->is_alive)
+			while (pending[slot])
 			{
-				auto probe_index = 0;
+				auto target = _vacancy(_pre_hash(_data.key(slot)), pending);
 				
-				auto new_hash = _linear_hash(old[i]->key, probe_index);
+				if (target == slot) pending[slot] = false;
 				
-				while (_nodes[new_hash])
+				else if (_data.is_empty(target))
 				{
-					new_hash = _linear_hash(old[i]->key, ++probe_index);
+					_data.move(slot, _data, target);
+					
+					pending[slot] = false;
 				}
 				
-				_nodes[new_hash] = old[i];
+				// The slot now holds another entry yet to move
+				else
+				{
+					_data.exchange(slot, target);
+					
+					pending[target] = false;
+				}
 			}
 		}
 	}
 	
-	void _clear()
+	void _compact(std::true_type)
+	{
+		_rehash(_capacity());
+	}
+	
+	// The first slot on the probe sequence that is empty or pending
+	size_t _vacancy(size_t hash, const std::vector<bool>& pending) const
 	{
-		for (size_t index = 0; index < _capacity; ++index)
+		auto first = _home(hash);
+		
+		for (size_t probe = 0; ; first = _next(first, hash, probe++))
 		{
-			if (_nodes[index]) delete _nodes[index];
+			for (size_t i = 0; i < GROUP_SIZE; ++i)
+			{
+				auto slot = _offset(first, i);
+				
+				if (_data.is_empty(slot) || pending[slot]) return slot;
+			}
 		}
-		
-		delete [] _nodes;
 	}
 	
-	Value& _get(const Key& key) const
+	// With no dead entries in the new array, the
+	// first free slot is always the first empty one
+	void _move(data_t& old, size_t index, std::false_type)
 	{
-		size_t index = 0;
+		auto hash = _pre_hash(old.key(index));
+		
+		auto first = _home(hash);
 		
-		for (auto hash = _linear_hash(key, index);
-			 _nodes[hash];
-			 hash = _linear_hash(key, ++index))
+		for (size_t probe = 0; ; first = _next(first, hash, probe++))
 		{
-			if (_nodes[hash]->is_alive && key == _nodes[hash]->key)
+			auto empty = _data.group(first, hash).empty;
+			
+			if (empty)
 			{
-				return _nodes[hash]->value;
+				old.move(index, _data, _offset(first, _lowest_bit(empty)));
+				
+				return;
 			}
 		}
+	}
+	
+	void _move(data_t& old, size_t index, std::true_type)
+	{
+		auto hash = _pre_hash(old.key(index));
+		
+		auto slot = _slot(old.key(index), hash).first;
 		
-		throw std::invalid_argument("No such key!");
+		_data.insert(slot, std::move(old.slot(index)), _distance(slot, hash));
 	}
 	
-	// Linear probing
-	size_t _linear_hash(const Key& key, size_t index) const
+	// How many slots past the home slot of the hash the slot is
+	size_t _distance(size_t slot, size_t hash) const
 	{
-		return (_pre_hash(key) + index) % _capacity;
+		return _offset(slot, _capacity() - _home(hash));
 	}
 	
-	size_t _quadratic_hash(const Key& key, size_t index) const
+	// The slot a number of slots (at most the capacity) past
+	// the given one, wrapping around without a division
+	size_t _offset(size_t slot, size_t offset) const
 	{
-		static const size_t c_1 = 69;
-		static const size_t c_2 = 123;
+		slot += offset;
 		
-		auto hash = _pre_hash(key) + c_1 * index + c_2 * (index * index);
-		
-		return hash % _capacity;
+		return (slot < _capacity()) ? slot : slot - _capacity();
 	}
 	
-	size_t _double_hash(const Key& key, size_t index)
+	static size_t _lowest_bit(std::uint32_t mask)
 	{
-		auto increment = index * _second_pre_hash(key);
+#ifdef __GNUC__
+		return __builtin_ctz(mask);
+#else
+		size_t bit = 0;
+		
+		for (; ! (mask & 1); mask >>= 1) ++bit;
 		
-		if (index && increment % 2 == 0) ++increment;
+		return bit;
+#endif
+	}
+	
+	template<typename Lookup>
+	Value& _get(const Lookup& key) const
+	{
+		auto slot = _find(key);
 		
-		auto hash = _first_pre_hash(key) + increment;
+		if (slot == NONE) throw std::invalid_argument("No such key!");
 		
-		return hash % _capacity;
+		return _data.value(slot);
 	}
 	
 	size_t _size;
 	
-	size_t _capacity;
+	// The number of dead entries, which take up slots until a rehash
+	size_t _dead;
 	
 	pre_hash_t _pre_hash;
 	
-	Node** _nodes;
+	key_equal_t _key_equal;
+	
+	data_t _data;
 };
 
-#endif /* OPEN_ADDRESSING_HASH_TABLE_HPP */
\ No newline at end of file
+template<
+	typename Key,
+	typename Value,
+	typename Layout,
+	typename Probing,
+	typename Hash,
+	typename KeyEqual
+>
+const typename OpenAddressingHashTable<Key, Value, Layout, Probing, Hash, KeyEqual>::size_t
+OpenAddressingHashTable<Key, Value, Layout, Probing, Hash, KeyEqual>::minimum_capacity;
+
+// The table with a pre-hash chosen at run time, as it was before
+template<
+	typename Key,
+	typename Value,
+	typename Layout = NodeLayout,
+	typename Probing = LinearProbing
+>
+using DynamicOpenAddressingHashTable =
+	OpenAddressingHashTable<Key, Value, Layout, Probing, PreHashFunction<Key>>;
+
+#endif /* OPEN_ADDRESSING_HASH_TABLE_HPP */
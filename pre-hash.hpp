@@ -0,0 +1,145 @@
+#ifndef PRE_HASH_HPP
+#define PRE_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// Any function of a key as a pre-hash, chosen at run time, which is what
+// the hash tables took before their pre-hash became a template parameter.
+// Every hash is an indirect call through it. Unlike a plain std::function
+// it starts out as std::hash, so a table can default-construct it.
+template<typename Key>
+class PreHashFunction : public std::function<std::size_t(const Key&)>
+{
+public:
+	
+	using function_t = std::function<std::size_t(const Key&)>;
+	
+	PreHashFunction()
+	: function_t(std::hash<Key>())
+	{ }
+	
+	PreHashFunction(function_t function)
+	: function_t(std::move(function))
+	{ }
+	
+	template<
+		typename Function,
+		typename = typename std::enable_if<
+			! std::is_base_of<function_t, typename std::decay<Function>::type>::value
+		>::type
+	>
+	PreHashFunction(Function function)
+	: function_t(std::move(function))
+	{ }
+};
+
+// Whether a table with the pre-hash and key equality can look up a key
+// of another type than its own without converting it, which they both
+// declare with an is_transparent member type, as for the standard
+// containers. The lookup type only makes this depend on the lookup.
+template<typename Hash, typename KeyEqual, typename Lookup, typename = void>
+struct is_transparent_lookup : std::false_type
+{ };
+
+template<typename Hash, typename KeyEqual, typename Lookup>
+struct is_transparent_lookup<
+	Hash,
+	KeyEqual,
+	Lookup,
+	typename std::conditional<
+		true,
+		void,
+		std::pair<typename Hash::is_transparent, typename KeyEqual::is_transparent>
+	>::type
+> : std::true_type
+{ };
+
+template<typename Hash, typename KeyEqual, typename Lookup>
+using transparent_lookup_t = typename std::enable_if<
+	is_transparent_lookup<Hash, KeyEqual, Lookup>::value
+>::type;
+
+// The characters of a std::string, of a C string, or of any string type
+// with data() and size() (such as std::string_view), without a copy
+class StringRange
+{
+public:
+	
+	template<typename String>
+	StringRange(const String& string)
+	: StringRange(string, std::is_convertible<const String&, const char*>())
+	{ }
+	
+	const char* data() const
+	{
+		return _data;
+	}
+	
+	std::size_t size() const
+	{
+		return _size;
+	}
+	
+	bool operator==(const StringRange& other) const
+	{
+		return _size == other._size && std::memcmp(_data, other._data, _size) == 0;
+	}
+	
+private:
+	
+	template<typename String>
+	StringRange(const String& string, std::false_type)
+	: _data(string.data())
+	, _size(string.size())
+	{ }
+	
+	StringRange(const char* string, std::true_type)
+	: _data(string)
+	, _size(std::strlen(string))
+	{ }
+	
+	const char* _data;
+	
+	std::size_t _size;
+};
+
+// A transparent pre-hash of strings, which hashes the characters alike
+// whichever type of string holds them, so that a table keyed by one can
+// be searched with any of the others
+struct StringHash
+{
+	using is_transparent = void;
+	
+	// FNV-1a
+	std::size_t operator()(StringRange string) const
+	{
+		std::uint64_t hash = 0xcbf29ce484222325;
+		
+		for (std::size_t i = 0; i < string.size(); ++i)
+		{
+			hash ^= static_cast<unsigned char>(string.data()[i]);
+			
+			hash *= 0x100000001b3;
+		}
+		
+		return static_cast<std::size_t>(hash);
+	}
+};
+
+// The key equality to go with StringHash
+struct StringEqual
+{
+	using is_transparent = void;
+	
+	bool operator()(StringRange first, StringRange second) const
+	{
+		return first == second;
+	}
+};
+
+#endif /* PRE_HASH_HPP */
@@ -2,23 +2,26 @@
 #define RED_BLACK_TREE_HPP
 
 #include <assert.h>
+#include <functional>
 #include <initializer_list>
 #include <stdexcept>
 
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare = std::less<Key>>
 class RedBlackTree
 {
 public:
 	
 	using size_t = std::size_t;
 	
-	RedBlackTree()
+	RedBlackTree(const Compare& compare = Compare())
 	: _size(0)
 	, _root(nullptr)
+	, _compare(compare)
 	{ }
 	
-	RedBlackTree(std::initializer_list<std::pair<Key, Value>> list)
-	: RedBlackTree()
+	RedBlackTree(std::initializer_list<std::pair<Key, Value>> list,
+				 const Compare& compare = Compare())
+	: RedBlackTree(compare)
 	{
 		for (const auto& item : list)
 		{
@@ -29,6 +32,7 @@ public:
 	RedBlackTree(const RedBlackTree& other)
 	: _size(other._size)
 	, _root(_copy(other._root))
+	, _compare(other._compare)
 	{ }
 	
 	RedBlackTree(RedBlackTree&& other) noexcept
@@ -53,6 +57,8 @@ public:
 		swap(_root, other._root);
 		
 		swap(_size, other._size);
+		
+		swap(_compare, other._compare);
 	}
 	
 	friend void swap(RedBlackTree& first, RedBlackTree& second) noexcept
@@ -97,13 +103,33 @@ public:
 	}
 	
 	
-	bool contains(const Key& key)
+	bool contains(const Key& key) const
 	{
 		auto node = _find(_root, key);
 		
 		return node != nullptr;
 	}
 	
+	// Given a transparent comparison (one with an is_transparent member
+	// type, such as std::less<>), these take any key it can compare
+	template<typename Lookup, typename C = Compare, typename = typename C::is_transparent>
+	Value& get(const Lookup& key)
+	{
+		return _get(key);
+	}
+	
+	template<typename Lookup, typename C = Compare, typename = typename C::is_transparent>
+	const Value& get(const Lookup& key) const
+	{
+		return _get(key);
+	}
+	
+	template<typename Lookup, typename C = Compare, typename = typename C::is_transparent>
+	bool contains(const Lookup& key) const
+	{
+		return _find(_root, key) != nullptr;
+	}
+	
 	
 	Value& operator[](const Key& key)
 	{
@@ -261,7 +287,7 @@ private:
 	{
 		if (! node) return 0;
 		
-		if (key < node->key) return _rank(node->left, key);
+		if (_compare(key, node->key)) return _rank(node->left, key);
 		
 		size_t rank = 1;
 		
@@ -276,7 +302,7 @@ private:
 	{
 		if (! node) return nullptr;
 		
-		if (key < node->key)
+		if (_compare(key, node->key))
 		{
 			auto result = _ceiling(node->left, key);
 			
@@ -290,7 +316,7 @@ private:
 	{
 		if (! node) return node;
 		
-		if (key > node->key)
+		if (_compare(node->key, key))
 		{
 			auto result = _floor(node->right, key);
 			
@@ -404,12 +430,12 @@ private:
 			return new Node(key, value);
 		}
 		
-		if (key < node->key)
+		if (_compare(key, node->key))
 		{
 			node->left = _insert(node->left, key, value);
 		}
 		
-		else if (key > node->key)
+		else if (_compare(node->key, key))
 		{
 			node->right = _insert(node->right, key, value);
 		}
@@ -428,12 +454,12 @@ private:
 			return new_node;
 		}
 		
-		if (new_node->key < node->key)
+		if (_compare(new_node->key, node->key))
 		{
 			node->left = _insert(node->left, new_node);
 		}
 		
-		else if (new_node->key > node->key)
+		else if (_compare(node->key, new_node->key))
 		{
 			node->right = _insert(node->right, new_node);
 		}
@@ -451,24 +477,38 @@ private:
 		return _handle_colors(node);
 	}
 	
-	Node* _find(Node* node, const Key& key) const
+	template<typename Lookup>
+	Node* _find(Node* node, const Lookup& key) const
 	{
 		if (! node) return nullptr;
 		
-		if (key < node->key) return _find(node->left, key);
+		if (_compare(key, node->key)) return _find(node->left, key);
 		
-		else if (key > node->key) return _find(node->right, key);
+		else if (_compare(node->key, key)) return _find(node->right, key);
 		
 		else return node;
 	}
 	
+	template<typename Lookup>
+	Value& _get(const Lookup& key) const
+	{
+		auto node = _find(_root, key);
+		
+		if (! node)
+		{
+			throw std::invalid_argument("No such key!");
+		}
+		
+		return node->value;
+	}
+	
 	Node* _erase(Node* node, const Key& key)
 	{
 		if (! node) throw std::invalid_argument("No such key!");
 		
-		if (key < node->key) node->left = _erase(node->left, key);
+		if (_compare(key, node->key)) node->left = _erase(node->left, key);
 		
-		else if (key > node->key) node->right = _erase(node->right, key);
+		else if (_compare(node->key, key)) node->right = _erase(node->right, key);
 		
 		else node = get_successor(node);
 		
@@ -543,6 +583,8 @@ private:
 	size_t _size;
 	
 	Node* _root;
+	
+	Compare _compare;
 };
 
 #endif /* RED_BLACK_TREE_HPP */
\ No newline at end of file
@@ -1,44 +1,77 @@
 #ifndef SEPARATE_CHAINING_HASH_TABLE_HPP
 #define SEPARATE_CHAINING_HASH_TABLE_HPP
 
+#include "pre-hash.hpp"
+
 #include <algorithm>
 #include <cmath>
 #include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
 
-template<typename Key, typename Value>
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>,
+	typename Allocator = std::allocator<std::pair<const Key, Value>>
+>
 class SeparateChainingHashTable
 {
 public:
 	
 	using size_t = std::size_t;
 	
-	using pre_hash_t = std::function<size_t(const Key& key)>;
+	using pre_hash_t = Hash;
+	
+	using key_equal_t = KeyEqual;
+	
+	// Rebound to allocate the nodes, one per entry, such as a
+	// SlabAllocator to carve them out of chunks of many
+	using allocator_t = Allocator;
 	
 	static const size_t minimum_capacity;
 	
-	SeparateChainingHashTable(const pre_hash_t& pre_hash = std::hash<Key>(),
+	SeparateChainingHashTable(const pre_hash_t& pre_hash = pre_hash_t(),
 							  size_t load_factor = 4,
-							  size_t capacity = minimum_capacity)
+							  size_t capacity = minimum_capacity,
+							  const key_equal_t& key_equal = key_equal_t(),
+							  const allocator_t& allocator = allocator_t())
 	: _size(0)
 	, _threshold(capacity)
-	, _pre_hash(pre_hash)
-	, _load_factor(load_factor)
 	, _capacity(_threshold/load_factor)
+	, _load_factor(load_factor)
+	, _pre_hash(pre_hash)
+	, _key_equal(key_equal)
+	, _allocator(allocator)
 	, _nodes(new Node*[_capacity])
+	, _old(nullptr)
+	, _old_capacity(0)
+	, _cursor(0)
+	, _incremental(false)
 	{
 		std::fill(_nodes, _nodes + _capacity, nullptr);
 	}
 	
 	SeparateChainingHashTable(std::initializer_list<std::pair<Key, Value>> list,
-							  const pre_hash_t& pre_hash = std::hash<Key>(),
+							  const pre_hash_t& pre_hash = pre_hash_t(),
 							  size_t load_factor = 4,
-							  size_t capacity = minimum_capacity)
+							  size_t capacity = minimum_capacity,
+							  const key_equal_t& key_equal = key_equal_t(),
+							  const allocator_t& allocator = allocator_t())
 	: _size(0)
 	, _threshold(std::max(capacity, list.size()))
-	, _pre_hash(pre_hash)
-	, _load_factor(load_factor)
 	, _capacity(_threshold/load_factor)
+	, _load_factor(load_factor)
+	, _pre_hash(pre_hash)
+	, _key_equal(key_equal)
+	, _allocator(allocator)
 	, _nodes(new Node*[_capacity])
+	, _old(nullptr)
+	, _old_capacity(0)
+	, _cursor(0)
+	, _incremental(false)
 	{
 		std::fill(_nodes, _nodes + _capacity, nullptr);
 		
@@ -49,12 +82,18 @@ public:
 	}
 	
 	SeparateChainingHashTable(const SeparateChainingHashTable& other)
-	: _size(other._size)
-	, _capacity(other._capacity)
+	: _size(0)
 	, _threshold(other._threshold)
-	, _pre_hash(other._pre_hash)
+	, _capacity(other._capacity)
 	, _load_factor(other._load_factor)
+	, _pre_hash(other._pre_hash)
+	, _key_equal(other._key_equal)
+	, _allocator(node_traits_t::select_on_container_copy_construction(other._allocator))
 	, _nodes(new Node*[_capacity])
+	, _old(nullptr)
+	, _old_capacity(0)
+	, _cursor(0)
+	, _incremental(other._incremental)
 	{
 		std::fill(_nodes, _nodes + _capacity, nullptr);
 		
@@ -65,6 +104,15 @@ public:
 				insert(node->key, node->value);
 			}
 		}
+		
+		// Along with those not yet moved by a resize under way
+		for (size_t i = other._cursor; other._old && i < other._old_capacity; ++i)
+		{
+			for (auto node = other._old[i]; node; node = node->next)
+			{
+				insert(node->key, node->value);
+			}
+		}
 	}
 	
 	SeparateChainingHashTable(SeparateChainingHashTable&& other) noexcept
@@ -88,11 +136,25 @@ public:
 		
 		swap(_capacity, other._capacity);
 		
+		swap(_threshold, other._threshold);
+		
 		swap(_size, other._size);
 		
 		swap(_pre_hash, other._pre_hash);
 		
+		swap(_key_equal, other._key_equal);
+		
+		swap(_allocator, other._allocator);
+		
 		swap(_load_factor, other._load_factor);
+		
+		swap(_old, other._old);
+		
+		swap(_old_capacity, other._old_capacity);
+		
+		swap(_cursor, other._cursor);
+		
+		swap(_incremental, other._incremental);
 	}
 	
 	friend void swap(SeparateChainingHashTable& first,
@@ -104,69 +166,74 @@ public:
 	~SeparateChainingHashTable()
 	{
 		_clear();
+		
+		delete [] _nodes;
+		
+		delete [] _old;
 	}
 	
 	
 	void insert(const Key& key, const Value& value)
 	{
-		auto index = _hash(key);
+		_step();
+		
+		auto node = _find(key);
 		
-		for (auto node = _nodes[index]; node; node = node->next)
+		if (node)
 		{
-			if (node->key == key)
-			{
-				node->value = value;
-				
-				return;
-			}
+			node->value = value;
+			
+			return;
 		}
 		
-		auto node = new Node(key, value, _nodes[index]);
+		auto index = _hash(key);
 		
-		_nodes[index] = node;
+		_nodes[index] = _new_node(key, value, _nodes[index]);
 		
-		if (++_size == _threshold) resize(_size * 2);
+		if (++_size == _threshold) resize(_size);
 	}
 	
 	
 	void erase(const Key& key)
 	{
-		auto index = _hash(key);
+		_step();
 		
-		Node* previous = nullptr;
-		
-		for (auto node = _nodes[index];
-			 node;
-			 previous = node, node = node->next)
+		if (! _unlink(_nodes[_hash(key)], key) &&
+			! (_old && _unlink(_old[_old_hash(key)], key)))
 		{
-			if (node->key == key)
-			{
-				if (previous) previous->next = node->next;
-				
-				else _nodes[index] = node->next;
-				
-				delete node;
-				
-				if (--_size == _threshold/4) resize(_size * 2);
-			}
+			throw std::invalid_argument("No such key!");
 		}
 		
-		throw std::invalid_argument("No such key!");
+		if (--_size == _threshold/4) resize(_size);
 	}
 	
 	void clear()
 	{
+		auto nodes = new Node*[minimum_capacity/_load_factor];
+		
+		std::fill(nodes, nodes + minimum_capacity/_load_factor, nullptr);
+		
 		_clear();
 		
-		_capacity = minimum_capacity;
+		delete [] _nodes;
 		
-		_nodes = new Node*[_capacity];
+		delete [] _old;
+		
+		_nodes = nodes;
+		
+		_old = nullptr;
+		
+		_threshold = minimum_capacity;
+		
+		_capacity = _threshold/_load_factor;
 		
 		_size = 0;
 	}
 	
 	Value& get(const Key& key)
 	{
+		_step();
+		
 		return _get(key);
 	}
 	
@@ -176,34 +243,50 @@ public:
 	}
 	
 	
-	bool contains(const Key& key)
+	bool contains(const Key& key) const
 	{
-		auto index = _hash(key);
-		
-		for (auto node = _nodes[index]; node; node = node->next)
-		{
-			if (node->key == key) return true;
-		}
+		return _find(key) != nullptr;
+	}
+	
+	// Given a transparent pre-hash and key equality, these take any
+	// key they accept, such as a C string for a std::string key
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	Value& get(const Lookup& key)
+	{
+		_step();
 		
-		return false;
+		return _get(key);
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	const Value& get(const Lookup& key) const
+	{
+		return _get(key);
+	}
+	
+	template<typename Lookup, typename = transparent_lookup_t<Hash, KeyEqual, Lookup>>
+	bool contains(const Lookup& key) const
+	{
+		return _find(key) != nullptr;
 	}
 	
 	
 	Value& operator[](const Key& key)
 	{
-		auto index = _hash(key);
+		_step();
 		
-		for (auto node = _nodes[index]; node; node = node->next)
-		{
-			if (node->key == key) return node->value;
-		}
+		auto node = _find(key);
+		
+		if (node) return node->value;
+		
+		auto index = _hash(key);
 		
-		auto node = new Node(key, Value(), _nodes[index]);
+		node = _new_node(key, Value(), _nodes[index]);
 		
 		_nodes[index] = node;
 		
-		if (++_size == _threshold) resize(_size * 2);
-			
+		if (++_size == _threshold) resize(_size);
+		
 		return node->value;
 	}
 	
@@ -239,16 +322,50 @@ public:
 	
 	void pre_hash(const pre_hash_t& pre_hash)
 	{
+		// The buckets not yet moved were found with the old pre-hash
+		_finish();
+		
 		_pre_hash = pre_hash;
 		
 		rehash();
 	}
 	
+	const key_equal_t& key_equal() const
+	{
+		return _key_equal;
+	}
+	
+	allocator_t get_allocator() const
+	{
+		return allocator_t(_allocator);
+	}
+	
+	
+	// Whether a resize moves the entries a few buckets at a time, over
+	// the operations that follow it, rather than all at once, in the
+	// manner of Redis. This bounds the pause of the operation that
+	// crosses the threshold, while lookups search both bucket arrays
+	// until the move is done.
+	bool incremental() const
+	{
+		return _incremental;
+	}
+	
+	void incremental(bool incremental)
+	{
+		if (! incremental) _finish();
+		
+		_incremental = incremental;
+	}
+	
 	
 	void resize(size_t size)
 	{
 		size = std::max(size, minimum_capacity/2);
 		
+		// Only one resize is under way at a time
+		_finish();
+		
 		auto old = _nodes;
 		
 		auto old_capacity = _capacity;
@@ -257,19 +374,31 @@ public:
 		
 		_capacity = _threshold / _load_factor;
 		
-		_size = size;
-		
 		_nodes = new Node*[_capacity];
 		
 		std::fill(_nodes, _nodes + _capacity, nullptr);
 		
-		_rehash(old, old_capacity);
+		if (_incremental)
+		{
+			_old = old;
+			
+			_old_capacity = old_capacity;
+			
+			_cursor = 0;
+		}
 		
-		delete [] old;
+		else
+		{
+			_rehash(old, old_capacity);
+			
+			delete [] old;
+		}
 	}
 	
 	void rehash()
 	{
+		_finish();
+		
 		auto old = _nodes;
 		
 		_nodes = new Node*[_capacity];
@@ -283,6 +412,10 @@ public:
 	
 private:
 	
+	// The buckets with entries that each operation moves, during an
+	// incremental resize, which outpaces the next one by far
+	static const size_t migration_steps = 4;
+	
 	struct Node
 	{
 		Node(const Key& key_,
@@ -301,18 +434,57 @@ private:
 		Node* next;
 	};
 	
+	using node_allocator_t = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+	
+	using node_traits_t = std::allocator_traits<node_allocator_t>;
+	
+	Node* _new_node(const Key& key, const Value& value, Node* next)
+	{
+		auto node = node_traits_t::allocate(_allocator, 1);
+		
+		try
+		{
+			node_traits_t::construct(_allocator, node, key, value, next);
+		}
+		
+		catch (...)
+		{
+			node_traits_t::deallocate(_allocator, node, 1);
+			
+			throw;
+		}
+		
+		return node;
+	}
+	
+	void _delete_node(Node* node)
+	{
+		node_traits_t::destroy(_allocator, node);
+		
+		node_traits_t::deallocate(_allocator, node, 1);
+	}
+	
 	void _clear()
 	{
-		for (size_t i = 0; i < _capacity; ++i)
+		_clear(_nodes, _capacity);
+		
+		if (_old) _clear(_old, _old_capacity);
+	}
+	
+	void _clear(Node** nodes, size_t capacity)
+	{
+		for (size_t i = 0; i < capacity; ++i)
 		{
-			for (auto node = _nodes[i]; node; )
+			for (auto node = nodes[i]; node; )
 			{
 				auto next = node->next;
 				
-				delete node;
+				_delete_node(node);
 				
 				node = next;
 			}
+			
+			nodes[i] = nullptr;
 		}
 	}
 	
@@ -320,31 +492,120 @@ private:
 	{
 		for (size_t i = 0; i < old_capacity; ++i)
 		{
-			for (auto node = _nodes[i]; node; )
+			_rehash(old[i]);
+		}
+	}
+	
+	// Moves the bucket's nodes into the current array
+	void _rehash(Node*& bucket)
+	{
+		for (auto node = bucket; node; )
+		{
+			auto new_index = _hash(node->key);
+			
+			auto next = node->next;
+			
+			node->next = _nodes[new_index];
+			
+			_nodes[new_index] = node;
+			
+			node = next;
+		}
+		
+		bucket = nullptr;
+	}
+	
+	// Moves a few more buckets, if a resize is under way. Empty buckets
+	// are cheap to pass over, but not free, so there is a limit to them.
+	void _step()
+	{
+		if (! _old) return;
+		
+		for (size_t moved = 0, visited = 0;
+			 moved < migration_steps &&
+			 visited < migration_steps * 10 &&
+			 _cursor < _old_capacity;
+			 ++visited, ++_cursor)
+		{
+			if (_old[_cursor])
 			{
-				auto new_index = _hash(node->key);
+				_rehash(_old[_cursor]);
 				
-				auto next = node->next;
+				++moved;
+			}
+		}
+		
+		if (_cursor == _old_capacity) _finish();
+	}
+	
+	// Moves the rest of the buckets, if a resize is under way
+	void _finish()
+	{
+		if (! _old) return;
+		
+		for ( ; _cursor < _old_capacity; ++_cursor)
+		{
+			_rehash(_old[_cursor]);
+		}
+		
+		delete [] _old;
+		
+		_old = nullptr;
+	}
+	
+	template<typename Lookup>
+	Node* _find(const Lookup& key) const
+	{
+		auto node = _search(_nodes[_hash(key)], key);
+		
+		// Those in buckets already moved are empty
+		if (! node && _old) node = _search(_old[_old_hash(key)], key);
+		
+		return node;
+	}
+	
+	template<typename Lookup>
+	Node* _search(Node* node, const Lookup& key) const
+	{
+		for ( ; node; node = node->next)
+		{
+			if (_key_equal(node->key, key)) return node;
+		}
+		
+		return nullptr;
+	}
+	
+	bool _unlink(Node*& bucket, const Key& key)
+	{
+		Node* previous = nullptr;
+		
+		for (auto node = bucket;
+			 node;
+			 previous = node, node = node->next)
+		{
+			if (_key_equal(node->key, key))
+			{
+				if (previous) previous->next = node->next;
 				
-				node->next = _nodes[new_index];
+				else bucket = node->next;
 				
-				_nodes[new_index] = node;
+				_delete_node(node);
 				
-				node = next;
+				return true;
 			}
 		}
+		
+		return false;
 	}
 	
-	Value& _get(const Key& key) const
+	template<typename Lookup>
+	Value& _get(const Lookup& key) const
 	{
-		auto index = _hash(key);
+		auto node = _find(key);
 		
-		for (auto node = _nodes[index]; node; node = node->next)
-		{
-			if (node->key == key) return node->value;
-		}
+		if (! node) throw std::invalid_argument("No such key!");
 		
-		throw std::invalid_argument("No such key!");
+		return node->value;
 	}
 	
 	size_t _hash3(const Key& key) const
@@ -370,11 +631,19 @@ private:
 		return ((_pre_hash(key) * constant) % word_max) >> wanted;
 	}
 	
-	size_t _hash(const Key& key) const
+	template<typename Lookup>
+	size_t _hash(const Lookup& key) const
 	{
 		return _pre_hash(key) % _capacity;
 	}
 	
+	// The key's bucket in the array a resize under way is moving from
+	template<typename Lookup>
+	size_t _old_hash(const Lookup& key) const
+	{
+		return _pre_hash(key) % _old_capacity;
+	}
+	
 	
 	size_t _size;
 	
@@ -386,12 +655,37 @@ private:
 	
 	pre_hash_t _pre_hash;
 	
+	key_equal_t _key_equal;
+	
+	node_allocator_t _allocator;
+	
 	Node** _nodes;
+	
+	// The bucket array a resize is moving from, while it is under way,
+	// and the first bucket of it not yet moved
+	Node** _old;
+	
+	size_t _old_capacity;
+	
+	size_t _cursor;
+	
+	bool _incremental;
 };
 
+template<
+	typename Key,
+	typename Value,
+	typename Hash,
+	typename KeyEqual,
+	typename Allocator
+>
+const typename SeparateChainingHashTable<Key, Value, Hash, KeyEqual, Allocator>::size_t
+SeparateChainingHashTable<Key, Value, Hash, KeyEqual, Allocator>::minimum_capacity = 16;
+
+// The table with a pre-hash chosen at run time, as it was before
 template<typename Key, typename Value>
-const typename SeparateChainingHashTable<Key, Value>::size_t
-SeparateChainingHashTable<Key, Value>::minimum_capacity = 16;
+using DynamicSeparateChainingHashTable =
+	SeparateChainingHashTable<Key, Value, PreHashFunction<Key>>;
 
 
 #endif /* SEPARATE_CHAINING_HASH_TABLE_HPP */
\ No newline at end of file
@@ -0,0 +1,190 @@
+#ifndef SLAB_ALLOCATOR_HPP
+#define SLAB_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// The chunks and free list that a SlabAllocator and its copies share,
+// whatever type each of them allocates
+class SlabPool
+{
+public:
+	
+	explicit SlabPool(std::size_t chunk_size)
+	: _chunk_size(chunk_size)
+	, _block(0)
+	, _free(nullptr)
+	, _next(nullptr)
+	, _left(0)
+	{ }
+	
+	SlabPool(const SlabPool&) = delete;
+	
+	SlabPool& operator=(const SlabPool&) = delete;
+	
+	~SlabPool()
+	{
+		for (auto chunk : _chunks) ::operator delete(chunk);
+	}
+	
+	// Whether objects of the size and alignment go in the blocks,
+	// whose size is set by the first object to come along
+	bool fits(std::size_t size, std::size_t alignment)
+	{
+		auto block = _round(size, alignment);
+		
+		if (! _block) _block = block;
+		
+		return block == _block && _block % alignment == 0;
+	}
+	
+	void* take()
+	{
+		if (_free)
+		{
+			auto block = _free;
+			
+			_free = _free->next;
+			
+			return block;
+		}
+		
+		if (! _left)
+		{
+			// Make room first, so that the chunk cannot leak
+			_chunks.push_back(nullptr);
+			
+			_chunks.back() = ::operator new(_block * _chunk_size);
+			
+			_next = static_cast<char*>(_chunks.back());
+			
+			_left = _chunk_size;
+		}
+		
+		auto block = _next;
+		
+		_next += _block;
+		
+		--_left;
+		
+		return block;
+	}
+	
+	void give(void* pointer) noexcept
+	{
+		auto block = static_cast<Block*>(pointer);
+		
+		block->next = _free;
+		
+		_free = block;
+	}
+	
+private:
+	
+	// A block on the free list holds the next one
+	struct Block
+	{
+		Block* next;
+	};
+	
+	// Chunks are aligned for anything, so blocks whose size
+	// is a multiple of an alignment are all aligned for it
+	static std::size_t _round(std::size_t size, std::size_t alignment)
+	{
+		size = std::max(size, sizeof(Block));
+		
+		alignment = std::max(alignment, alignof(Block));
+		
+		return (size + alignment - 1) / alignment * alignment;
+	}
+	
+	std::size_t _chunk_size;
+	
+	std::size_t _block;
+	
+	Block* _free;
+	
+	char* _next;
+	
+	std::size_t _left;
+	
+	std::vector<void*> _chunks;
+};
+
+// An allocator for containers of nodes, such as SeparateChainingHashTable,
+// which hands out one object at a time from chunks of many, and keeps the
+// ones given back on a free list for the next, rather than going to the
+// heap for each. Nodes allocated in a row thus lie side by side. Copies
+// and rebound copies share the chunks, as allocators must to free each
+// other's memory, and the last of them gives the chunks back. Only single
+// objects of the size of the first one come from the chunks, anything
+// else from the heap. Not thread-safe.
+template<typename T, std::size_t ChunkSize = 1024>
+class SlabAllocator
+{
+public:
+	
+	using value_type = T;
+	
+	template<typename U>
+	struct rebind
+	{
+		using other = SlabAllocator<U, ChunkSize>;
+	};
+	
+	SlabAllocator()
+	: _pool(std::make_shared<SlabPool>(ChunkSize))
+	{ }
+	
+	template<typename U>
+	SlabAllocator(const SlabAllocator<U, ChunkSize>& other) noexcept
+	: _pool(other._pool)
+	{ }
+	
+	T* allocate(std::size_t count)
+	{
+		if (count == 1 && _pool->fits(sizeof(T), alignof(T)))
+		{
+			return static_cast<T*>(_pool->take());
+		}
+		
+		return static_cast<T*>(::operator new(count * sizeof(T)));
+	}
+	
+	void deallocate(T* pointer, std::size_t count) noexcept
+	{
+		if (count == 1 && _pool->fits(sizeof(T), alignof(T))) _pool->give(pointer);
+		
+		else ::operator delete(pointer);
+	}
+	
+	// A copy of a container starts out with chunks of its own
+	SlabAllocator select_on_container_copy_construction() const
+	{
+		return SlabAllocator();
+	}
+	
+	template<typename U>
+	bool operator==(const SlabAllocator<U, ChunkSize>& other) const noexcept
+	{
+		return _pool == other._pool;
+	}
+	
+	template<typename U>
+	bool operator!=(const SlabAllocator<U, ChunkSize>& other) const noexcept
+	{
+		return _pool != other._pool;
+	}
+	
+private:
+	
+	template<typename, std::size_t>
+	friend class SlabAllocator;
+	
+	std::shared_ptr<SlabPool> _pool;
+};
+
+#endif /* SLAB_ALLOCATOR_HPP */
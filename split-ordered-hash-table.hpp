@@ -0,0 +1,663 @@
+#ifndef SPLIT_ORDERED_HASH_TABLE_HPP
+#define SPLIT_ORDERED_HASH_TABLE_HPP
+
+#include "cache-line-array.hpp"
+#include "pre-hash.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A lock-free separate chaining hash table for many threads, after
+// Shalev and Shavit's split-ordered lists. All chains are one sorted
+// lock-free linked list, in the style of Harris and Michael: a node is
+// deleted by marking its link before unlinking it, so that nothing can
+// be inserted after it meanwhile. Buckets point into the list at dummy
+// nodes, and are filled in lazily, when first used.
+//
+// The list is sorted by the bit-reversed hash, so that the entries of
+// a bucket are a run of it, which halves in two when the number of
+// buckets doubles: growing only adds buckets and dummies, and never
+// moves a node. No operation waits for another thread.
+//
+// Deleted nodes are freed by epoch-based reclamation. Every operation
+// takes one of a fixed number of slots for its duration, announcing the
+// epoch it started in, and the nodes it unlinks are freed only once all
+// operations from that epoch on have ended. At most SLOTS operations run
+// at once, any more wait for a slot. Values cannot be changed in place,
+// since readers copy them without a lock: insert adds keys, not assigns.
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>
+>
+class SplitOrderedHashTable
+{
+public:
+	
+	using size_t = std::size_t;
+	
+	using pre_hash_t = Hash;
+	
+	using key_equal_t = KeyEqual;
+	
+	// The number of reclamation slots, which bounds the operations at once
+	static const size_t SLOTS = 256;
+	
+	static const size_t MINIMUM_CAPACITY = 16;
+	
+	
+	SplitOrderedHashTable(const pre_hash_t& pre_hash = pre_hash_t(),
+						  size_t load_factor = 4,
+						  size_t capacity = MINIMUM_CAPACITY,
+						  const key_equal_t& key_equal = key_equal_t())
+	: _pre_hash(pre_hash)
+	, _key_equal(key_equal)
+	, _load_factor(load_factor)
+	, _buckets(_capacity(capacity / load_factor))
+	, _epoch(0)
+	, _slots(SLOTS)
+	{
+		for (auto& segment : _segments) segment.store(nullptr, std::memory_order_relaxed);
+		
+		_bucket_link(0).store(new Link(0), std::memory_order_relaxed);
+	}
+	
+	SplitOrderedHashTable(const SplitOrderedHashTable&) = delete;
+	
+	SplitOrderedHashTable& operator=(const SplitOrderedHashTable&) = delete;
+	
+	~SplitOrderedHashTable()
+	{
+		for (auto link = _bucket_link(0).load(); link; )
+		{
+			auto next = _pointer(link->next.load());
+			
+			_delete(link);
+			
+			link = next;
+		}
+		
+		for (size_t slot = 0; slot < SLOTS; ++slot)
+		{
+			for (const auto& retired : _slots[slot].limbo) _delete(retired.second);
+		}
+		
+		for (auto& segment : _segments) delete [] segment.load();
+	}
+	
+	
+	// Inserts the key if it is not there, returns false if it was
+	bool insert(const Key& key, const Value& value)
+	{
+		Guard guard(*this);
+		
+		auto hash = _hash(key);
+		
+		auto start = _bucket(hash & (_buckets.load() - 1), guard.slot);
+		
+		auto node = new Node(_regular(hash), key, value);
+		
+		std::atomic<std::uintptr_t>* previous;
+		
+		Link* current;
+		
+		while (true)
+		{
+			if (_search(start, node->order, &key, guard.slot, previous, current))
+			{
+				delete node;
+				
+				return false;
+			}
+			
+			node->next.store(_word(current), std::memory_order_relaxed);
+			
+			auto expected = _word(current);
+			
+			if (previous->compare_exchange_strong(expected, _word(node))) break;
+		}
+		
+		auto count = guard.slot.count.fetch_add(1, std::memory_order_relaxed) + 1;
+		
+		// Summing up the slots is slow, so only every so often
+		if (count % 64 == 0) _grow();
+		
+		return true;
+	}
+	
+	void erase(const Key& key)
+	{
+		if (! erase_if_found(key))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+	}
+	
+	bool erase_if_found(const Key& key)
+	{
+		Guard guard(*this);
+		
+		auto hash = _hash(key);
+		
+		auto start = _bucket(hash & (_buckets.load() - 1), guard.slot);
+		
+		auto order = _regular(hash);
+		
+		std::atomic<std::uintptr_t>* previous;
+		
+		Link* current;
+		
+		while (true)
+		{
+			if (! _search(start, order, &key, guard.slot, previous, current))
+			{
+				return false;
+			}
+			
+			auto next = current->next.load();
+			
+			// Marking the link deletes the node, whoever unlinks it
+			if (! _marked(next) && current->next.compare_exchange_strong(next, next | MARK))
+			{
+				break;
+			}
+		}
+		
+		auto expected = _word(current);
+		
+		if (previous->compare_exchange_strong(expected, _word(_pointer(current->next.load()))))
+		{
+			_retire(current, guard.slot);
+		}
+		
+		// Otherwise the list changed around it, and a search unlinks it
+		else _search(start, order, &key, guard.slot, previous, current);
+		
+		guard.slot.count.fetch_sub(1, std::memory_order_relaxed);
+		
+		return true;
+	}
+	
+	
+	// Copies the key's value into the argument, returns false if absent
+	bool find(const Key& key, Value& value) const
+	{
+		Guard guard(*this);
+		
+		auto hash = _hash(key);
+		
+		auto start = _bucket(hash & (_buckets.load() - 1), guard.slot);
+		
+		std::atomic<std::uintptr_t>* previous;
+		
+		Link* current;
+		
+		if (! _search(start, _regular(hash), &key, guard.slot, previous, current))
+		{
+			return false;
+		}
+		
+		value = static_cast<Node*>(current)->value;
+		
+		return true;
+	}
+	
+	Value at(const Key& key) const
+	{
+		Value value;
+		
+		if (! find(key, value))
+		{
+			throw std::invalid_argument("No such key!");
+		}
+		
+		return value;
+	}
+	
+	bool contains(const Key& key) const
+	{
+		Guard guard(*this);
+		
+		auto hash = _hash(key);
+		
+		auto start = _bucket(hash & (_buckets.load() - 1), guard.slot);
+		
+		std::atomic<std::uintptr_t>* previous;
+		
+		Link* current;
+		
+		return _search(start, _regular(hash), &key, guard.slot, previous, current);
+	}
+	
+	
+	// Only a snapshot, since other threads may be modifying the table
+	size_t size() const
+	{
+		// A slot's count goes down for entries another slot added
+		std::ptrdiff_t size = 0;
+		
+		for (size_t slot = 0; slot < SLOTS; ++slot)
+		{
+			size += _slots[slot].count.load(std::memory_order_relaxed);
+		}
+		
+		return size > 0 ? size : 0;
+	}
+	
+	bool is_empty() const
+	{
+		return size() == 0;
+	}
+	
+	// The number of buckets, which only grows
+	size_t capacity() const
+	{
+		return _buckets.load();
+	}
+	
+	size_t load_factor() const
+	{
+		return _load_factor;
+	}
+	
+	const pre_hash_t& pre_hash() const
+	{
+		return _pre_hash;
+	}
+	
+	const key_equal_t& key_equal() const
+	{
+		return _key_equal;
+	}
+	
+private:
+	
+	using hash_t = std::uint64_t;
+	
+	// A link of the list, on its own a bucket's dummy node. Its next
+	// pointer has the lowest bit set (marked) once the link is deleted.
+	struct Link
+	{
+		Link(hash_t order_)
+		: order(order_)
+		, next(0)
+		{ }
+		
+		// The bit-reversed hash, odd for entries and even for dummies
+		const hash_t order;
+		
+		std::atomic<std::uintptr_t> next;
+	};
+	
+	struct Node : Link
+	{
+		Node(hash_t order_, const Key& key_, const Value& value_)
+		: Link(order_)
+		, key(key_)
+		, value(value_)
+		{ }
+		
+		const Key key;
+		
+		const Value value;
+	};
+	
+	// The epoch an operation started in, or IDLE while the slot is free,
+	// with the nodes its operations unlinked and the epochs they did so in
+	struct Slot
+	{
+		Slot()
+		: epoch(IDLE)
+		, count(0)
+		{ }
+		
+		std::atomic<std::uint64_t> epoch;
+		
+		// The entries added less those erased in the slot's operations
+		std::atomic<std::ptrdiff_t> count;
+		
+		// Only touched by the operation holding the slot
+		std::vector<std::pair<std::uint64_t, Link*>> limbo;
+		
+		// Fill the slot's cache line, which _slots aligns it to
+		char padding[64 - sizeof(std::atomic<std::uint64_t>) - sizeof(std::atomic<std::ptrdiff_t>) - sizeof(std::vector<std::pair<std::uint64_t, Link*>>)];
+	};
+	
+	// Holds a slot for the duration of an operation
+	struct Guard
+	{
+		Guard(const SplitOrderedHashTable& table_)
+		: table(table_)
+		, slot(table_._enter())
+		{ }
+		
+		~Guard()
+		{
+			table._leave(slot);
+		}
+		
+		const SplitOrderedHashTable& table;
+		
+		Slot& slot;
+	};
+	
+	static const std::uintptr_t MARK = 1;
+	
+	static const std::uint64_t IDLE = ~std::uint64_t(0);
+	
+	// Buckets are kept in segments of doubling size, allocated when
+	// first used, so that adding buckets moves none: the first segment
+	// holds buckets 0 and 1, and segment i after it buckets 2^i to 2^(i+1)
+	static const size_t SEGMENTS = 64;
+	
+	// Retired nodes are only freed once there are this many in a slot
+	static const size_t RECLAIM_THRESHOLD = 64;
+	
+	
+	static size_t _capacity(size_t buckets)
+	{
+		size_t power = 2;
+		
+		while (power < buckets) power *= 2;
+		
+		return power;
+	}
+	
+	template<typename Lookup>
+	hash_t _hash(const Lookup& key) const
+	{
+		hash_t hash = _pre_hash(key);
+		
+		// The 64-bit finalizer of MurmurHash3
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccd;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53;
+		hash ^= hash >> 33;
+		
+		return hash;
+	}
+	
+	static hash_t _reverse(hash_t bits)
+	{
+		bits = ((bits >> 1) & 0x5555555555555555) | ((bits & 0x5555555555555555) << 1);
+		bits = ((bits >> 2) & 0x3333333333333333) | ((bits & 0x3333333333333333) << 2);
+		bits = ((bits >> 4) & 0x0f0f0f0f0f0f0f0f) | ((bits & 0x0f0f0f0f0f0f0f0f) << 4);
+		bits = ((bits >> 8) & 0x00ff00ff00ff00ff) | ((bits & 0x00ff00ff00ff00ff) << 8);
+		bits = ((bits >> 16) & 0x0000ffff0000ffff) | ((bits & 0x0000ffff0000ffff) << 16);
+		
+		return (bits >> 32) | (bits << 32);
+	}
+	
+	// Entries set the top bit of the hash before reversing it, so that
+	// they sort after the dummy of their bucket, whose order is even
+	static hash_t _regular(hash_t hash)
+	{
+		return _reverse(hash | (hash_t(1) << 63));
+	}
+	
+	static hash_t _dummy(size_t bucket)
+	{
+		return _reverse(bucket);
+	}
+	
+	static bool _marked(std::uintptr_t word)
+	{
+		return word & MARK;
+	}
+	
+	static Link* _pointer(std::uintptr_t word)
+	{
+		return reinterpret_cast<Link*>(word & ~MARK);
+	}
+	
+	static std::uintptr_t _word(Link* link)
+	{
+		return reinterpret_cast<std::uintptr_t>(link);
+	}
+	
+	static void _delete(Link* link)
+	{
+		if (link->order & 1) delete static_cast<Node*>(link);
+		
+		else delete link;
+	}
+	
+	
+	std::atomic<Link*>& _bucket_link(size_t bucket) const
+	{
+		size_t segment = 0;
+		
+		for (auto rest = bucket >> 1; rest; rest >>= 1) ++segment;
+		
+		auto& pointer = _segments[segment];
+		
+		auto buckets = pointer.load();
+		
+		if (! buckets)
+		{
+			size_t size = segment ? size_t(1) << segment : 2;
+			
+			auto fresh = new std::atomic<Link*>[size];
+			
+			for (size_t index = 0; index < size; ++index)
+			{
+				fresh[index].store(nullptr, std::memory_order_relaxed);
+			}
+			
+			if (pointer.compare_exchange_strong(buckets, fresh)) buckets = fresh;
+			
+			else delete [] fresh;
+		}
+		
+		return buckets[segment ? bucket - (size_t(1) << segment) : bucket];
+	}
+	
+	// The bucket's dummy, which is added to the list after its parent's,
+	// the bucket it split off from, which is added first if need be
+	Link* _bucket(size_t bucket, Slot& slot) const
+	{
+		auto& pointer = _bucket_link(bucket);
+		
+		auto dummy = pointer.load();
+		
+		if (dummy) return dummy;
+		
+		// The parent is the bucket without its highest bit
+		size_t highest = 1;
+		
+		while (highest <= bucket / 2) highest <<= 1;
+		
+		auto start = _bucket(bucket & ~highest, slot);
+		
+		dummy = new Link(_dummy(bucket));
+		
+		std::atomic<std::uintptr_t>* previous;
+		
+		Link* current;
+		
+		while (true)
+		{
+			if (_search(start, dummy->order, nullptr, slot, previous, current))
+			{
+				// Another thread added it first
+				delete dummy;
+				
+				dummy = current;
+				
+				break;
+			}
+			
+			dummy->next.store(_word(current), std::memory_order_relaxed);
+			
+			auto expected = _word(current);
+			
+			if (previous->compare_exchange_strong(expected, _word(dummy))) break;
+		}
+		
+		pointer.store(dummy);
+		
+		return dummy;
+	}
+	
+	// Looks for the order (and key, unless a dummy) in the list after
+	// the start, unlinking deleted nodes on the way. Leaves the link where
+	// it is, or should go, and the node there, and returns whether found.
+	bool _search(Link* start,
+				 hash_t order,
+				 const Key* key,
+				 Slot& slot,
+				 std::atomic<std::uintptr_t>*& previous,
+				 Link*& current) const
+	{
+	retry:
+		
+		previous = &start->next;
+		
+		current = _pointer(previous->load());
+		
+		while (current)
+		{
+			auto next = current->next.load();
+			
+			if (_marked(next))
+			{
+				auto expected = _word(current);
+				
+				if (! previous->compare_exchange_strong(expected, next & ~MARK))
+				{
+					goto retry;
+				}
+				
+				_retire(current, slot);
+				
+				current = _pointer(next);
+				
+				continue;
+			}
+			
+			if (current->order > order) return false;
+			
+			if (current->order == order &&
+				(! key || _key_equal(static_cast<Node*>(current)->key, *key)))
+			{
+				return true;
+			}
+			
+			previous = &current->next;
+			
+			current = _pointer(next);
+		}
+		
+		return false;
+	}
+	
+	// Doubles the buckets if the entries outgrew them, the new ones
+	// to be filled in by the first operations to come along
+	void _grow()
+	{
+		auto buckets = _buckets.load();
+		
+		if (size() > buckets * _load_factor && buckets < (size_t(1) << (SEGMENTS - 1)))
+		{
+			_buckets.compare_exchange_strong(buckets, buckets * 2);
+		}
+	}
+	
+	
+	Slot& _enter() const
+	{
+		auto start = std::hash<std::thread::id>()(std::this_thread::get_id());
+		
+		for (size_t attempt = 0; ; ++attempt)
+		{
+			auto& slot = _slots[(start + attempt) % SLOTS];
+			
+			auto idle = IDLE;
+			
+			if (slot.epoch.load(std::memory_order_relaxed) == IDLE &&
+				slot.epoch.compare_exchange_strong(idle, _epoch.load()))
+			{
+				return slot;
+			}
+			
+			if (attempt % SLOTS == SLOTS - 1) std::this_thread::yield();
+		}
+	}
+	
+	void _leave(Slot& slot) const
+	{
+		if (slot.limbo.size() >= RECLAIM_THRESHOLD)
+		{
+			_advance();
+			
+			_reclaim(slot);
+		}
+		
+		slot.epoch.store(IDLE, std::memory_order_release);
+	}
+	
+	// A node unlinked now may still be in use by operations started in
+	// this epoch or the one before, but none started later can reach it
+	void _retire(Link* link, Slot& slot) const
+	{
+		slot.limbo.emplace_back(_epoch.load(), link);
+	}
+	
+	// Moves to the next epoch, if no operation is still in an older one
+	void _advance() const
+	{
+		auto epoch = _epoch.load();
+		
+		for (size_t slot = 0; slot < SLOTS; ++slot)
+		{
+			auto announced = _slots[slot].epoch.load();
+			
+			if (announced != IDLE && announced != epoch) return;
+		}
+		
+		_epoch.compare_exchange_strong(epoch, epoch + 1);
+	}
+	
+	// Frees the slot's nodes retired two epochs ago or more. The epochs
+	// only go up, so these are the ones at the front.
+	void _reclaim(Slot& slot) const
+	{
+		auto epoch = _epoch.load();
+		
+		auto& limbo = slot.limbo;
+		
+		size_t freed = 0;
+		
+		while (freed < limbo.size() && limbo[freed].first + 2 <= epoch)
+		{
+			_delete(limbo[freed++].second);
+		}
+		
+		limbo.erase(limbo.begin(), limbo.begin() + freed);
+	}
+	
+	
+	pre_hash_t _pre_hash;
+	
+	key_equal_t _key_equal;
+	
+	size_t _load_factor;
+	
+	std::atomic<size_t> _buckets;
+	
+	mutable std::atomic<std::atomic<Link*>*> _segments[SEGMENTS];
+	
+	mutable std::atomic<std::uint64_t> _epoch;
+	
+	CacheLineArray<Slot> _slots;
+};
+
+#endif /* SPLIT_ORDERED_HASH_TABLE_HPP */
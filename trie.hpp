@@ -1,9 +1,38 @@
 #ifndef TRIE_HPP
 #define TRIE_HPP
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
+
+// Whether a trie can look up a key of the type, which is either a C
+// string or a string type with length() and operator[]
+template<typename Lookup, typename = void>
+struct is_trie_lookup : std::is_convertible<const Lookup&, const char*>
+{ };
+
+template<typename Lookup>
+struct is_trie_lookup<
+	Lookup,
+	typename std::conditional<
+		true,
+		void,
+		std::pair<
+			decltype(std::declval<const Lookup&>().length()),
+			decltype(std::declval<const Lookup&>()[std::size_t()])
+		>
+	>::type
+> : std::true_type
+{ };
+
+template<typename Lookup>
+using trie_lookup_t = typename std::enable_if<is_trie_lookup<Lookup>::value>::type;
 
 template<typename Value, typename String = std::string, std::size_t N = 128>
 class Trie
@@ -73,7 +102,7 @@ public:
 	
 	Value& operator[](const String& key)
 	{
-		auto node = _find(_root, key);
+		auto node = _find(_root, key, key.length());
 		
 		if (! node)
 		{
@@ -86,34 +115,25 @@ public:
 	}
 	
 	
-	Value& get(const String& key)
+	// The lookups take a key of any string type with length() and
+	// operator[] (such as std::string_view), or a C string, as well
+	template<typename Lookup, typename = trie_lookup_t<Lookup>>
+	Value& get(const Lookup& key)
 	{
-		auto node = _find(_root, key);
-		
-		if (! node)
-		{
-			throw std::invalid_argument("No such key!");
-		}
-		
-		return node->value;
+		return _get(key);
 	}
 	
-	const Value& get(const String& key) const
+	template<typename Lookup, typename = trie_lookup_t<Lookup>>
+	const Value& get(const Lookup& key) const
 	{
-		auto node = _find(_root, key);
-		
-		if (! node)
-		{
-			throw std::invalid_argument("No such key!");
-		}
-		
-		return node->value;
+		return _get(key);
 	}
 	
 	
-	bool contains(const String& key)
+	template<typename Lookup, typename = trie_lookup_t<Lookup>>
+	bool contains(const Lookup& key) const
 	{
-		return _find(_root, key) != nullptr;
+		return _find(_root, key, _length(key)) != nullptr;
 	}
 	
 	
@@ -205,18 +225,49 @@ private:
 		return node;
 	}
 	
-	Node* _find(Node* node, const String& key, size_t index = 0)
+	template<typename Lookup>
+	Node* _find(Node* node, const Lookup& key, size_t length, size_t index = 0) const
 	{
 		if (! node) return nullptr;
 		
-		if (index == key.length())
+		if (index == length)
 		{
 			return node->has_value ? node : nullptr;
 		}
 		
 		auto& next = node->next[key[index]];
 		
-		return _find(next, key, ++index);
+		return _find(next, key, length, ++index);
+	}
+	
+	template<typename Lookup>
+	Value& _get(const Lookup& key) const
+	{
+		auto node = _find(_root, key, _length(key));
+		
+		if (! node)
+		{
+			throw std::invalid_argument("No such key!");
+		}
+		
+		return node->value;
+	}
+	
+	template<typename Lookup>
+	static size_t _length(const Lookup& key)
+	{
+		return _length(key, std::is_convertible<const Lookup&, const char*>());
+	}
+	
+	template<typename Lookup>
+	static size_t _length(const Lookup& key, std::false_type)
+	{
+		return key.length();
+	}
+	
+	static size_t _length(const char* key, std::true_type)
+	{
+		return std::strlen(key);
 	}
 	
 	Node* _erase(Node* node, const String& key, size_t index = 0)